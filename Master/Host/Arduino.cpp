@@ -0,0 +1,163 @@
+/*
+ * Host (Linux) stand-in for the parts of the Arduino core used by Master/Itho.
+ */
+
+#include <Arduino.h>
+#include <chrono>
+#include <thread>
+#include <atomic>
+
+HardwareSerial Serial;
+
+static uint8_t pinLevel[HOST_NUM_PINS];
+static void (*pinIsr[HOST_NUM_PINS])(void);
+static int pinIsrMode[HOST_NUM_PINS];
+static host_pin_hook_t pinHook[HOST_NUM_PINS];
+static void *pinHookCtx[HOST_NUM_PINS];
+
+// delay() does not sleep: it advances a virtual offset on top of the
+// monotonic clock, so replays run at full CPU speed while millis()/micros()
+// still move forward the way the firmware expects.
+static std::atomic<uint64_t> delayOffsetUs(0);
+
+static uint64_t nowUs()
+{
+	static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	uint64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+	return elapsed + delayOffsetUs.load(std::memory_order_relaxed);
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+	if (pin < HOST_NUM_PINS && mode == INPUT_PULLUP)
+		pinLevel[pin] = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+	if (pin >= HOST_NUM_PINS)
+		return;
+	pinLevel[pin] = val;
+	if (pinHook[pin])
+		pinHook[pin](pinHookCtx[pin], pin, val);
+}
+
+int digitalRead(uint8_t pin)
+{
+	// MISO reads low: the simulated CC1101 is always ready (CHIP_RDYn = 0)
+	if (pin >= HOST_NUM_PINS || pin == MISO)
+		return LOW;
+	return pinLevel[pin];
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode)
+{
+	if (pin >= HOST_NUM_PINS)
+		return;
+	pinIsr[pin] = isr;
+	pinIsrMode[pin] = mode;
+}
+
+void detachInterrupt(uint8_t pin)
+{
+	if (pin < HOST_NUM_PINS)
+		pinIsr[pin] = 0;
+}
+
+void hostSetPinLevel(uint8_t pin, uint8_t val)
+{
+	if (pin >= HOST_NUM_PINS)
+		return;
+	uint8_t old = pinLevel[pin];
+	pinLevel[pin] = val;
+	if (!pinIsr[pin] || old == val)
+		return;
+	if (pinIsrMode[pin] == CHANGE
+			|| (pinIsrMode[pin] == RISING && val == HIGH)
+			|| (pinIsrMode[pin] == FALLING && val == LOW))
+		pinIsr[pin]();
+}
+
+void hostSetPinHook(uint8_t pin, host_pin_hook_t hook, void *ctx)
+{
+	if (pin >= HOST_NUM_PINS)
+		return;
+	pinHook[pin] = hook;
+	pinHookCtx[pin] = ctx;
+}
+
+unsigned long millis(void)
+{
+	return (unsigned long)(nowUs() / 1000);
+}
+
+unsigned long micros(void)
+{
+	return (unsigned long)nowUs();
+}
+
+void delay(unsigned long ms)
+{
+	delayOffsetUs.fetch_add((uint64_t)ms * 1000, std::memory_order_relaxed);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+	delayOffsetUs.fetch_add(us, std::memory_order_relaxed);
+}
+
+void yield(void)
+{
+	std::this_thread::yield();
+}
+
+int HardwareSerial::printf(const char *format, ...)
+{
+	va_list args;
+	int len;
+
+	va_start(args, format);
+	if (out)
+		len = vfprintf(out, format, args);
+	else
+		len = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+
+	return len;
+}
+
+size_t HardwareSerial::print(const char *s)
+{
+	return printf("%s", s);
+}
+
+size_t HardwareSerial::print(int n)
+{
+	return printf("%d", n);
+}
+
+size_t HardwareSerial::println(const char *s)
+{
+	return printf("%s\n", s);
+}
+
+size_t HardwareSerial::println(int n)
+{
+	return printf("%d\n", n);
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+	return printf("%c", c);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+	return out ? fwrite(buffer, 1, size, out) : size;
+}
+
+void HardwareSerial::flush()
+{
+	if (out)
+		fflush(out);
+}
@@ -0,0 +1,108 @@
+/*
+ * Host (Linux) stand-in for the parts of the Arduino core used by Master/Itho.
+ *
+ * Only what the library and the sketch actually call is provided: pin I/O,
+ * delays/timing, interrupts, a printf-capable Serial and the Print base that
+ * Serial and flash files share.
+ */
+
+#ifndef HOST_ARDUINO_H_
+#define HOST_ARDUINO_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+// lets libraries tell the host build apart, like ARDUINO_ARCH_ESP32 and friends
+#define ARDUINO_ARCH_HOST
+
+#define HIGH              0x1
+#define LOW               0x0
+
+#define INPUT             0x0
+#define OUTPUT            0x1
+#define INPUT_PULLUP      0x2
+
+#define RISING            0x1
+#define FALLING           0x2
+#define CHANGE            0x3
+
+#define ICACHE_RAM_ATTR
+#define IRAM_ATTR
+
+#define F(s) (s)
+#define digitalPinToInterrupt(p) (p)
+
+// SPI pins, numbered as on an ESP32 VSPI bus
+static const uint8_t SS   = 5;
+static const uint8_t MOSI = 23;
+static const uint8_t MISO = 19;
+static const uint8_t SCK  = 18;
+
+#define HOST_NUM_PINS 64
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t pin);
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield(void);
+
+// Host only: drive an input pin from a simulated peripheral, firing any
+// interrupt attached to it on a matching edge.
+void hostSetPinLevel(uint8_t pin, uint8_t val);
+
+// Host only: a peripheral that wants to see chip select changes on a pin.
+typedef void (*host_pin_hook_t)(void *ctx, uint8_t pin, uint8_t val);
+void hostSetPinHook(uint8_t pin, host_pin_hook_t hook, void *ctx);
+
+// byte sink, as in the Arduino core
+class Print
+{
+	public:
+		virtual ~Print() {}
+		virtual size_t write(uint8_t c) = 0;
+		virtual size_t write(const uint8_t *buffer, size_t size)
+		{
+			size_t n = 0;
+			while (size-- && write(*buffer++))
+				n++;
+			return n;
+		}
+};
+
+class HardwareSerial : public Print
+{
+	public:
+		HardwareSerial() : out(stdout) {}
+
+		void begin(unsigned long baud) { (void)baud; }
+		void end() {}
+
+		int printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+		size_t print(const char *s);
+		size_t print(int n);
+		size_t println(const char *s = "");
+		size_t println(int n);
+		size_t write(uint8_t c);
+		size_t write(const uint8_t *buffer, size_t size);
+		void flush();
+
+		// Host only: redirect output, or discard it with NULL (e.g. when profiling).
+		void setOutput(FILE *f) { out = f; }
+
+	private:
+		FILE *out;
+};
+
+extern HardwareSerial Serial;
+
+#endif /* HOST_ARDUINO_H_ */
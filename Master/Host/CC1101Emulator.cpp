@@ -0,0 +1,485 @@
+/*
+ * Register-level CC1101 model for the host build.
+ */
+
+#include "CC1101Emulator.h"
+#include "CC1101.h"
+
+#define EMU_FIFO_SIZE       64
+#define EMU_BYTE_US         208     // one byte at 38.4 kBaud
+#define EMU_SCAL_US         712     // SCAL strobe, 26 MHz crystal
+#define EMU_AUTOCAL_US      799     // IDLE to RX or TX with MCSM0.FS_AUTOCAL = 1
+
+static const uint8_t resetValues[0x2F] = {
+	0x29, 0x2E, 0x3F, 0x07, 0xD3, 0x91, 0xFF, 0x04,     // 0x00 IOCFG2 .. PKTCTRL1
+	0x45, 0x00, 0x00, 0x0F, 0x00, 0x1E, 0xC4, 0xEC,     // 0x08 PKTCTRL0 .. FREQ0
+	0x8C, 0x22, 0x02, 0x22, 0xF8, 0x47, 0x07, 0x30,     // 0x10 MDMCFG4 .. MCSM1
+	0x04, 0x36, 0x6C, 0x03, 0x40, 0x91, 0x87, 0x6B,     // 0x18 MCSM0 .. WOREVT0
+	0xF8, 0x56, 0x10, 0xA9, 0x0A, 0x20, 0x0D, 0x41,     // 0x20 WORCTRL .. RCCTRL1
+	0x00, 0x59, 0x7F, 0x3F, 0x88, 0x31, 0x0B            // 0x28 RCCTRL0 .. TEST0
+};
+
+CC1101Emulator::CC1101Emulator()
+	: expectHeader(true), pollOnly(false), accessRead(false), accessBurst(false), accessAddress(0),
+	  inPacket(false), packetBytes(0), packetLength(0), rssi(0x80), lqi(0),
+	  noiseState(0x12345678), calEndUs(0), calNextState(CC1101_MARCSTATE_IDLE), txStartUs(0), txBytes(0)
+{
+	memset(gdoPin, 0xFF, sizeof(gdoPin));
+	memset(gdoLevel, LOW, sizeof(gdoLevel));
+	reset();
+	resetStats();
+}
+
+void CC1101Emulator::connectGdo(uint8_t gdo, uint8_t pin)
+{
+	if (gdo > 2)
+		return;
+	gdoPin[gdo] = pin;
+	gdoLevel[gdo] = LOW;
+	hostSetPinLevel(pin, LOW);
+	updateGdo();
+}
+
+bool CC1101Emulator::gdoSignal(uint8_t config) const
+{
+	unsigned threshold = ((regs[CC1101_FIFOTHR] & 0x0F) + 1) * 4;
+
+	switch (config & 0x3F) {
+		case 0x00:  // RX FIFO at or above threshold
+			return rxFifo.size() >= threshold;
+		case 0x01:  // RX FIFO at or above threshold, or end of packet; until empty
+			return rxFifo.size() >= threshold || (packetReceived && !rxFifo.empty());
+		case 0x06:  // sync word received, until end of packet
+			return inPacket;
+		case 0x07:  // packet received, until the first byte is read
+			return packetReceived;
+		default:
+			return false;
+	}
+}
+
+void CC1101Emulator::updateGdo()
+{
+	static const uint8_t iocfg[3] = { CC1101_IOCFG0, CC1101_IOCFG1, CC1101_IOCFG2 };
+
+	for (unsigned i = 0; i < 3; i++) {
+		if (gdoPin[i] == 0xFF)
+			continue;
+		bool level = gdoSignal(regs[iocfg[i]]);
+		if (regs[iocfg[i]] & 0x40)     // GDOx_INV
+			level = !level;
+		if (level != gdoLevel[i]) {
+			gdoLevel[i] = level;
+			hostSetPinLevel(gdoPin[i], level ? HIGH : LOW);
+		}
+	}
+}
+
+void CC1101Emulator::resetStats()
+{
+	memset(&counters, 0, sizeof(counters));
+}
+
+void CC1101Emulator::reset()
+{
+	memcpy(regs, resetValues, sizeof(regs));
+	memset(patable, 0, sizeof(patable));
+	patable[0] = 0xC6;
+	patableIndex = 0;
+	state = CC1101_MARCSTATE_IDLE;
+	rxFifo.clear();
+	rxRepeat = false;
+	txFifo.clear();
+	txUnderflow = false;
+	inPacket = false;
+	packetReceived = false;
+}
+
+void CC1101Emulator::select()
+{
+	expectHeader = true;
+	pollOnly = true;
+	counters.spiTransactions++;
+}
+
+void CC1101Emulator::deselect()
+{
+	// burst accesses end here; the PATABLE index resets with chip select
+	patableIndex = 0;
+	expectHeader = true;
+	if (pollOnly)
+		counters.pollTransactions++;
+}
+
+uint8_t CC1101Emulator::statusByte(bool read) const
+{
+	uint8_t chipState;
+
+	switch (state) {
+		case CC1101_MARCSTATE_IDLE:             chipState = CC1101_STATE_IDLE; break;
+		case CC1101_MARCSTATE_RX:
+		case CC1101_MARCSTATE_RX_END:
+		case CC1101_MARCSTATE_RX_RST:           chipState = CC1101_STATE_RX; break;
+		case CC1101_MARCSTATE_TX:
+		case CC1101_MARCSTATE_TX_END:           chipState = CC1101_STATE_TX; break;
+		case CC1101_MARCSTATE_FSTXON:           chipState = CC1101_STATE_FSTXON; break;
+		case CC1101_MARCSTATE_RXFIFO_OVERFLOW:  chipState = CC1101_STATE_RX_OVERFLOW; break;
+		case CC1101_MARCSTATE_TXFIFO_UNDERFLOW: chipState = CC1101_STATE_TX_UNDERFLOW; break;
+		default:                                chipState = CC1101_STATE_CALIBRATE; break;
+	}
+
+	size_t avail = read ? rxFifo.size() : EMU_FIFO_SIZE - 1 - txFifo.size();
+	if (avail > CC1101_STATUS_FIFO_BYTES_AVAILABLE_BM)
+		avail = CC1101_STATUS_FIFO_BYTES_AVAILABLE_BM;
+
+	return chipState | (uint8_t)avail;
+}
+
+uint8_t CC1101Emulator::transfer(uint8_t data)
+{
+	uint8_t result;
+
+	counters.spiBytes++;
+	if (state == CC1101_MARCSTATE_MANCAL || state == CC1101_MARCSTATE_STARTCAL)
+		endCalibration();
+	if (state == CC1101_MARCSTATE_TX)
+		pumpTx();
+
+	if (expectHeader) {
+		accessRead = (data & CC1101_READ_SINGLE) != 0;
+		accessBurst = (data & CC1101_WRITE_BURST) != 0;
+		accessAddress = data & 0x3F;
+		result = statusByte(accessRead);
+		if (accessAddress != CC1101_SNOP && !(accessRead && accessBurst && accessAddress >= CC1101_PARTNUM))
+			pollOnly = false;
+
+		if (accessAddress >= CC1101_SRES && accessAddress <= CC1101_SNOP && !(accessRead && accessBurst)) {
+			// command strobe: header only, next byte is a new header
+			strobe(accessAddress);
+			updateGdo();
+			return result;
+		}
+		expectHeader = false;
+		return result;
+	}
+
+	if (accessRead) {
+		result = readRegister(accessAddress, accessBurst);
+	}
+	else {
+		result = statusByte(false);
+		writeRegister(accessAddress, data);
+	}
+
+	if (accessAddress >= CC1101_PARTNUM && accessAddress <= CC1101_RCCTRL0_STATUS)
+		expectHeader = true;    // status registers cannot be burst accessed
+	else if (!accessBurst)
+		expectHeader = true;
+	else if (accessAddress < CC1101_PATABLE)
+		accessAddress++;
+
+	updateGdo();
+	return result;
+}
+
+uint8_t CC1101Emulator::readRegister(uint8_t address, bool burst)
+{
+	uint8_t value;
+
+	if (address < sizeof(regs))
+		return regs[address];
+
+	switch (address) {
+		case CC1101_PATABLE:
+			value = patable[patableIndex];
+			if (burst)
+				patableIndex = (patableIndex + 1) & 7;
+			return value;
+		case CC1101_RXFIFO:
+			if (rxFifo.empty())
+				return 0;
+			value = rxFifo.front();
+			rxFifo.pop_front();
+			packetReceived = false;
+			if (rxRepeat)
+				counters.rxFifoErrata++;
+			// CC1101 errata: emptying the RX FIFO while a packet is still
+			// coming in makes the last byte read come out again
+			rxRepeat = rxFifo.empty() && inPacket;
+			if (rxRepeat)
+				rxFifo.push_front(value);
+			return value;
+		case CC1101_PARTNUM:            return 0x00;
+		case CC1101_VERSION:            return 0x14;
+		case CC1101_FREQEST:            return 0x00;
+		case CC1101_LQI:                return 0x80 | lqi;
+		case CC1101_RSSI:               return rssi;
+		case CC1101_MARCSTATE:          return state;
+		case CC1101_PKTSTATUS:          return inPacket ? 0x08 : 0x00;
+		case CC1101_TXBYTES:            return (txUnderflow ? 0x80 : 0x00) | (uint8_t)txFifo.size();
+		case CC1101_RXBYTES:            return (state == CC1101_MARCSTATE_RXFIFO_OVERFLOW ? 0x80 : 0x00) | (uint8_t)rxFifo.size();
+		default:                        return 0x00;
+	}
+}
+
+void CC1101Emulator::writeRegister(uint8_t address, uint8_t data)
+{
+	if (address < sizeof(regs)) {
+		regs[address] = data;
+		updateGdo();
+		return;
+	}
+
+	switch (address) {
+		case CC1101_PATABLE:
+			patable[patableIndex] = data;
+			patableIndex = (patableIndex + 1) & 7;
+			break;
+		case CC1101_TXFIFO:
+			if (txFifo.size() < EMU_FIFO_SIZE)
+				txFifo.push_back(data);
+			break;
+	}
+}
+
+void CC1101Emulator::strobe(uint8_t command)
+{
+	counters.strobes++;
+
+	switch (command) {
+		case CC1101_SRES:
+			reset();
+			break;
+		case CC1101_SFSTXON:
+			inPacket = false;
+			state = CC1101_MARCSTATE_FSTXON;
+			break;
+		case CC1101_SCAL:
+			if (state == CC1101_MARCSTATE_IDLE)
+				calibrate(CC1101_MARCSTATE_MANCAL, EMU_SCAL_US, CC1101_MARCSTATE_IDLE);
+			break;
+		case CC1101_SRX:
+			if (state == CC1101_MARCSTATE_TX)
+				endTx(CC1101_MARCSTATE_RX);
+			if (state == CC1101_MARCSTATE_IDLE && autoCalibrate())
+				calibrate(CC1101_MARCSTATE_STARTCAL, EMU_AUTOCAL_US, CC1101_MARCSTATE_RX);
+			else if (state != CC1101_MARCSTATE_RXFIFO_OVERFLOW && state != CC1101_MARCSTATE_TXFIFO_UNDERFLOW)
+				state = CC1101_MARCSTATE_RX;
+			break;
+		case CC1101_STX:
+			if (state == CC1101_MARCSTATE_RXFIFO_OVERFLOW || state == CC1101_MARCSTATE_TXFIFO_UNDERFLOW)
+				break;
+			inPacket = false;
+			if (state == CC1101_MARCSTATE_IDLE && autoCalibrate()) {
+				calibrate(CC1101_MARCSTATE_STARTCAL, EMU_AUTOCAL_US, CC1101_MARCSTATE_TX);
+				break;
+			}
+			startTx(micros());
+			break;
+		case CC1101_SIDLE:
+		case CC1101_SPWD:
+		case CC1101_SXOFF:
+			if (state == CC1101_MARCSTATE_TX)
+				endTx(CC1101_MARCSTATE_IDLE);
+			inPacket = false;
+			state = CC1101_MARCSTATE_IDLE;
+			break;
+		case CC1101_SFRX:
+			if (state == CC1101_MARCSTATE_IDLE || state == CC1101_MARCSTATE_RXFIFO_OVERFLOW) {
+				rxFifo.clear();
+				rxRepeat = false;
+				packetReceived = false;
+				state = CC1101_MARCSTATE_IDLE;
+			}
+			break;
+		case CC1101_SFTX:
+			if (state == CC1101_MARCSTATE_IDLE || state == CC1101_MARCSTATE_TXFIFO_UNDERFLOW) {
+				txFifo.clear();
+				txUnderflow = false;
+				state = CC1101_MARCSTATE_IDLE;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+void CC1101Emulator::queueFrame(const uint8_t *data, size_t length, unsigned gap, uint8_t rssi, uint8_t lqi)
+{
+	AirByte silence = { 0, false, true, 0, 0 };
+	for (unsigned i = 0; i < gap; i++)
+		timeline.push_back(silence);
+
+	for (size_t i = 0; i < length; i++) {
+		AirByte b = { data[i], i == 0, false, rssi, lqi };
+		timeline.push_back(b);
+	}
+	counters.framesQueued++;
+}
+
+uint8_t CC1101Emulator::noise()
+{
+	noiseState = noiseState * 1103515245 + 12345;
+	return (uint8_t)(noiseState >> 16);
+}
+
+void CC1101Emulator::air(unsigned byteTimes)
+{
+	if (state == CC1101_MARCSTATE_MANCAL || state == CC1101_MARCSTATE_STARTCAL)
+		endCalibration();
+
+	while (byteTimes--) {
+		if (timeline.empty()) {
+			if (!inPacket)
+				return;
+			// carrier gone, the demodulator keeps clocking out noise
+			rxByte(noise());
+			continue;
+		}
+
+		AirByte b = timeline.front();
+		timeline.pop_front();
+
+		if (inPacket) {
+			rxByte(b.silence ? noise() : b.data);
+			continue;
+		}
+		if (!b.frameStart)
+			continue;
+		if (state != CC1101_MARCSTATE_RX) {
+			counters.framesMissed++;
+			continue;
+		}
+
+		// sync word detected
+		inPacket = true;
+		packetBytes = 0;
+		packetLength = 0;
+		rssi = b.rssi;
+		lqi = b.lqi;
+		rxByte(b.data);
+	}
+}
+
+void CC1101Emulator::rxByte(uint8_t data)
+{
+	if (rxFifo.size() >= EMU_FIFO_SIZE) {
+		inPacket = false;
+		state = CC1101_MARCSTATE_RXFIFO_OVERFLOW;
+		counters.rxOverflows++;
+		updateGdo();
+		return;
+	}
+
+	rxFifo.push_back(data);
+	packetBytes++;
+	updateGdo();
+
+	switch (regs[CC1101_PKTCTRL0] & 0x03) {
+		case 0x00:  // fixed length
+			packetLength = regs[CC1101_PKTLEN] ? regs[CC1101_PKTLEN] : 256;
+			break;
+		case 0x01:  // variable length, first byte is the length
+			if (packetBytes == 1)
+				packetLength = data + 1;
+			break;
+		default:    // infinite
+			packetLength = 0;
+			break;
+	}
+
+	if (packetLength && packetBytes >= packetLength)
+		endPacket();
+}
+
+void CC1101Emulator::endPacket()
+{
+	inPacket = false;
+
+	if (regs[CC1101_PKTCTRL1] & 0x04) {
+		// APPEND_STATUS: RSSI, then CRC_OK | LQI
+		if (rxFifo.size() + 2 > EMU_FIFO_SIZE) {
+			state = CC1101_MARCSTATE_RXFIFO_OVERFLOW;
+			counters.rxOverflows++;
+			updateGdo();
+			return;
+		}
+		rxFifo.push_back(rssi);
+		rxFifo.push_back(0x80 | lqi);
+	}
+	counters.framesReceived++;
+	packetReceived = true;
+
+	// MCSM1.RXOFF_MODE
+	state = ((regs[CC1101_MCSM1] >> 2) & 0x03) == 0x03 ? CC1101_MARCSTATE_RX : CC1101_MARCSTATE_IDLE;
+	updateGdo();
+}
+
+bool CC1101Emulator::autoCalibrate() const
+{
+	// MCSM0.FS_AUTOCAL = 1: calibrate when going from IDLE to RX or TX
+	return ((regs[CC1101_MCSM0] >> 4) & 0x03) == 0x01;
+}
+
+// Calibration takes real time, as TX does; the result is left in FSCAL1.
+void CC1101Emulator::calibrate(uint8_t calState, unsigned us, uint8_t nextState)
+{
+	state = calState;
+	calEndUs = micros() + us;
+	calNextState = nextState;
+}
+
+void CC1101Emulator::endCalibration()
+{
+	if ((long)(micros() - calEndUs) < 0)
+		return;
+
+	regs[CC1101_FSCAL1] = 0x1C;
+	state = CC1101_MARCSTATE_IDLE;
+	if (calNextState == CC1101_MARCSTATE_TX)
+		startTx(calEndUs);
+	else
+		state = calNextState;
+}
+
+void CC1101Emulator::startTx(unsigned long us)
+{
+	state = CC1101_MARCSTATE_TX;
+	txStartUs = us;
+	txBytes = 0;
+	txFrame.clear();
+	pumpTx();
+}
+
+void CC1101Emulator::pumpTx()
+{
+	unsigned due = (unsigned)((micros() - txStartUs) / EMU_BYTE_US) + 1;
+	bool fixed = (regs[CC1101_PKTCTRL0] & 0x03) == 0x00;
+	unsigned length = regs[CC1101_PKTLEN] ? regs[CC1101_PKTLEN] : 256;
+
+	while (state == CC1101_MARCSTATE_TX && txBytes < due) {
+		if (fixed && txBytes >= length) {
+			// MCSM1.TXOFF_MODE
+			endTx((regs[CC1101_MCSM1] & 0x03) == 0x03 ? CC1101_MARCSTATE_RX : CC1101_MARCSTATE_IDLE);
+			return;
+		}
+		if (txFifo.empty()) {
+			txUnderflow = true;
+			endTx(CC1101_MARCSTATE_TXFIFO_UNDERFLOW);
+			return;
+		}
+		txFrame.push_back(txFifo.front());
+		txFifo.pop_front();
+		txBytes++;
+	}
+}
+
+void CC1101Emulator::endTx(uint8_t nextState)
+{
+	if (!txFrame.empty()) {
+		txLog.push_back(txFrame);
+		txFrame.clear();
+		counters.framesSent++;
+	}
+	state = nextState;
+}
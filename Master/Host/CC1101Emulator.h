@@ -0,0 +1,137 @@
+/*
+ * Register-level CC1101 model for the host build.
+ *
+ * Speaks the CC1101 SPI protocol (header byte with R/W and burst bits,
+ * command strobes, status registers, 64 byte RX/TX FIFOs) well enough to run
+ * the unmodified CC1101/RAMSES driver against it. Received frames are queued
+ * on an "air" timeline that the caller advances explicitly, one byte-time at
+ * a time, so replays are deterministic and run at full CPU speed.
+ * Transmission and synthesizer calibration take real (micros()) time.
+ */
+
+#ifndef CC1101EMULATOR_H_
+#define CC1101EMULATOR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <vector>
+#include <SPI.h>
+
+class CC1101Emulator : public SPIDevice
+{
+	public:
+		struct Stats {
+			unsigned long spiTransactions;  // chip select assertions
+			unsigned long spiBytes;         // bytes clocked over MOSI/MISO
+			unsigned long strobes;
+			unsigned long pollTransactions; // transactions with nothing but SNOPs and status register reads
+			unsigned long framesQueued;
+			unsigned long framesReceived;   // packets completed into the RX FIFO
+			unsigned long framesMissed;     // sync word arrived while not in RX
+			unsigned long rxOverflows;
+			unsigned long rxFifoErrata;     // bytes read twice: the RX FIFO was read empty while a packet came in
+			unsigned long framesSent;
+		};
+
+		CC1101Emulator();
+
+		// SPIDevice
+		void select();
+		void deselect();
+		uint8_t transfer(uint8_t data);
+
+		// Queue a frame (the bytes following the sync word) after 'gap'
+		// byte-times of silence.
+		void queueFrame(const uint8_t *data, size_t length, unsigned gap = 0, uint8_t rssi = 0xD0, uint8_t lqi = 0x20);
+
+		// Advance the air timeline by the given number of byte-times.
+		void air(unsigned byteTimes);
+
+		// True when no queued frame is left and no packet is being received.
+		bool airIdle() const { return timeline.empty() && !inPacket; }
+
+		// Wire GDO0 or GDO2 to a host pin; its level follows IOCFG0/IOCFG2
+		// (only the RX FIFO and packet signals are modelled) and edges fire
+		// any interrupt attached to the pin.
+		void connectGdo(uint8_t gdo, uint8_t pin);
+
+		uint8_t marcState() const { return state; }
+		const Stats &stats() const { return counters; }
+		void resetStats();
+
+		// Transmitted packets, in the order they left the TX FIFO.
+		const std::vector<std::vector<uint8_t> > &sent() const { return txLog; }
+
+	private:
+		struct AirByte {
+			uint8_t data;
+			bool frameStart;
+			bool silence;
+			uint8_t rssi;
+			uint8_t lqi;
+		};
+
+		void reset();
+		void strobe(uint8_t command);
+		uint8_t statusByte(bool read) const;
+		uint8_t readRegister(uint8_t address, bool burst);
+		void writeRegister(uint8_t address, uint8_t data);
+
+		void rxByte(uint8_t data);
+		void endPacket();
+		bool autoCalibrate() const;
+		void calibrate(uint8_t calState, unsigned us, uint8_t nextState);
+		void endCalibration();
+		void startTx(unsigned long us);
+		void pumpTx();
+		void endTx(uint8_t nextState);
+		uint8_t noise();
+		bool gdoSignal(uint8_t config) const;
+		void updateGdo();
+
+		uint8_t regs[0x2F];
+		uint8_t patable[8];
+		uint8_t patableIndex;
+		uint8_t state;
+
+		std::deque<uint8_t> rxFifo;
+		bool rxRepeat;                  // the front byte of rxFifo is an errata repeat
+		std::deque<uint8_t> txFifo;
+		bool txUnderflow;
+
+		// SPI framing
+		bool expectHeader;
+		bool pollOnly;
+		bool accessRead;
+		bool accessBurst;
+		uint8_t accessAddress;
+
+		// receive side
+		std::deque<AirByte> timeline;
+		bool inPacket;
+		unsigned packetBytes;
+		unsigned packetLength;
+		uint8_t rssi;
+		uint8_t lqi;
+		uint32_t noiseState;
+
+		// frequency synthesizer calibration in progress
+		unsigned long calEndUs;
+		uint8_t calNextState;
+
+		// transmit side
+		unsigned long txStartUs;
+		unsigned txBytes;
+		std::vector<uint8_t> txFrame;
+		std::vector<std::vector<uint8_t> > txLog;
+
+		// GDO0, GDO1, GDO2
+		uint8_t gdoPin[3];
+		uint8_t gdoLevel[3];
+		bool packetReceived;
+
+		Stats counters;
+};
+
+#endif /* CC1101EMULATOR_H_ */
@@ -0,0 +1,39 @@
+/*
+ * Host (Linux) stand-in for the Arduino SPI library.
+ */
+
+#include <SPI.h>
+
+SPIClass SPI;
+
+static void chipSelectHook(void *ctx, uint8_t pin, uint8_t val)
+{
+	SPIDevice **device = (SPIDevice **)ctx;
+	(void)pin;
+
+	if (!*device)
+		return;
+	if (val == LOW)
+		(*device)->select();
+	else
+		(*device)->deselect();
+}
+
+void SPIClass::begin()
+{
+	hostSetPinHook(SS, chipSelectHook, &device);
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+	return device ? device->transfer(data) : 0xFF;
+}
+
+void SPIClass::transferBytes(const uint8_t *out, uint8_t *in, uint32_t size)
+{
+	for (uint32_t i = 0; i < size; i++) {
+		uint8_t r = transfer(out ? out[i] : 0xFF);
+		if (in)
+			in[i] = r;
+	}
+}
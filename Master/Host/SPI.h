@@ -0,0 +1,67 @@
+/*
+ * Host (Linux) stand-in for the Arduino SPI library.
+ *
+ * Transfers are forwarded to an attached SPIDevice (normally the CC1101
+ * emulator); chip select is the SS pin, driven through digitalWrite().
+ */
+
+#ifndef HOST_SPI_H_
+#define HOST_SPI_H_
+
+#include <Arduino.h>
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x01
+#define SPI_MODE2 0x02
+#define SPI_MODE3 0x03
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+class SPISettings
+{
+	public:
+		SPISettings() : clock(1000000), bitOrder(MSBFIRST), dataMode(SPI_MODE0) {}
+		SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode)
+			: clock(clock), bitOrder(bitOrder), dataMode(dataMode) {}
+
+		uint32_t clock;
+		uint8_t bitOrder;
+		uint8_t dataMode;
+};
+
+class SPIDevice
+{
+	public:
+		virtual ~SPIDevice() {}
+
+		virtual void select() = 0;
+		virtual void deselect() = 0;
+		virtual uint8_t transfer(uint8_t data) = 0;
+};
+
+class SPIClass
+{
+	public:
+		SPIClass() : device(0) {}
+
+		void begin();
+		void end() {}
+
+		void beginTransaction(SPISettings settings) { this->settings = settings; }
+		void endTransaction() {}
+
+		uint8_t transfer(uint8_t data);
+		void transferBytes(const uint8_t *out, uint8_t *in, uint32_t size);
+
+		// Host only: route transfers and chip select to a simulated device.
+		void attach(SPIDevice *device) { this->device = device; }
+
+	private:
+		SPIDevice *device;
+		SPISettings settings;
+};
+
+extern SPIClass SPI;
+
+#endif /* HOST_SPI_H_ */
@@ -0,0 +1,857 @@
+/*
+ * Replay recorded CC1101 frames through the RAMSES receive path on the host.
+ *
+ * Every frame is put on the air of the emulated CC1101 and picked up by
+ * RAMSES::checkForNewPacket(), exactly as the sketch's loop() would, so the
+ * SPI traffic, messageDecode() and messageInterpret() all run
+ * unmodified at full CPU speed. The events are counted, and printed
+ * unless -q is given, as is the deferred log (drained between loop()
+ * iterations, at RAMSES_LOG_* level -v, 2 for warnings by default).
+ *
+ * The air is advanced one byte-time at a time with a number of loop()
+ * iterations (-l) in between, separated by -g byte-times of silence. With -r
+ * every frame goes on the air several times, like a remote's retransmissions,
+ * and with -w loop() only gets to run every so many byte-times, as when the
+ * sketch is busy elsewhere; frames read while the next one was already in the
+ * FIFO are reported (a flush after every frame used to lose those). Copies
+ * of a frame seen within RAMSES_DEDUP_WINDOW_MS count as retransmissions,
+ * so with -n or -r only the first copy is accepted, unless -u turns that
+ * off. With -i
+ * the receiver runs off the GDO2 end-of-packet interrupt instead of polling
+ * the FIFO on every iteration; compare the SPI transactions per frame.
+ *
+ * With -t the decoder runs in a thread of its own, fed through the raw frame
+ * ring by RAMSES::receivePacket() on the main thread, as on the ESP32 where
+ * it runs on the other core; frames dropped because the ring was full are
+ * reported. A third thread keeps reading the last message snapshot in
+ * place and reports reads that had to be retried, and any that were torn.
+ *
+ * With -s only the SPI cost of RAMSES::initReceive(), of a RAMSES::sendPacket()
+ * RX/TX/RX turnaround (reconfiguring the chip or switching fast) and of
+ * CC1101::sendData() (with a packet longer than the TX FIFO) is reported,
+ * along with the RAMSES::sendCommand() frame cache hits.
+ *
+ * With -d the frames are instead decoded directly by the single pass
+ * RAMSES::messageDecode(), the multi-stage reference decoder and the
+ * RAMSESStreamDecoder, and any difference in outcome or parsed fields is
+ * reported.
+ *
+ * With -z the frames are replaced by a reproducible fuzz set generated from
+ * the seed: the loaded frames and messages with random fields (header and
+ * ID count that disagree, trailing bytes), encoded by RAMSES::messageEncode(),
+ * then mostly damaged by bit flips, byte changes, truncation or insertion,
+ * plus pure noise. With -d the stream decoder's rejects are counted by reason.
+ *
+ * With -e every frame messageDecode() accepts is re-encoded with
+ * RAMSES::messageEncode(); the encoded frame must decode to the same fields
+ * with both decoders and match the recorded bits up to the end of the 0x35
+ * trailer symbol.
+ *
+ * With -o every frame the receiver reads, rejected ones included, is
+ * captured to a file through RAMSESRecorder, as a device would to Serial or
+ * flash. A capture can be replayed instead of a frames.txt; it is mapped and
+ * walked in place, record by record.
+ *
+ * usage: ramses_replay [-n iterations] [-l loops] [-g gap] [-r repeats] [-w every] [-i] [-t] [-q] [-d] [-e] [-s] [-u] [-v level] [-o capture] [-z seed] [frames.txt|capture]
+ */
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "CC1101Emulator.h"
+#include "RAMSES.h"
+
+#define IRQ_PIN 22
+
+#ifndef RAMSES_SAMPLE_FRAMES
+#define RAMSES_SAMPLE_FRAMES "frames/sample.txt"
+#endif
+
+typedef std::vector<uint8_t> frame_t;
+
+static int hexval(int c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+// A capture written by -o or a device's RAMSESRecorder; a truncated last
+// record (the capture was still being written) ends it.
+static bool loadCapture(const char *path, std::vector<frame_t> &frames)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+
+	if (fd < 0)
+		return false;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(RAMSESCaptureHeader)) {
+		close(fd);
+		return false;
+	}
+	size_t size = st.st_size;
+	void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+
+	const uint8_t *base = (const uint8_t *)map;
+	const RAMSESCaptureHeader *header = (const RAMSESCaptureHeader *)base;
+	bool ok = header->version == RAMSES_CAPTURE_VERSION && header->headerSize >= sizeof(RAMSESCaptureHeader);
+	for (size_t at = header->headerSize; ok && at + sizeof(RAMSESCaptureRecord) <= size; ) {
+		const RAMSESCaptureRecord *record = (const RAMSESCaptureRecord *)(base + at);
+		uint8_t data[sizeof(((CC1101Packet *)0)->data)];
+
+		if (record->size < sizeof(RAMSESCaptureRecord) || record->size % 8 || at + record->size > size)
+			break;
+		if (record->length && ramsesCaptureExpand(record, data, sizeof(data)))
+			frames.push_back(frame_t(data, data + record->length));
+		at += record->size;
+	}
+
+	munmap(map, size);
+	return ok;
+}
+
+static bool loadFrames(const char *path, std::vector<frame_t> &frames)
+{
+	FILE *f = fopen(path, "r");
+	char line[1024];
+
+	if (!f)
+		return false;
+	if (fread(line, 1, 4, f) == 4 && memcmp(line, RAMSES_CAPTURE_MAGIC, 4) == 0) {
+		fclose(f);
+		return loadCapture(path, frames);
+	}
+	rewind(f);
+
+	while (fgets(line, sizeof(line), f)) {
+		frame_t frame;
+		int hi = -1;
+
+		for (char *c = line; *c && *c != '#'; c++) {
+			int v = hexval(*c);
+			if (v < 0)
+				continue;
+			if (hi < 0) {
+				hi = v;
+			}
+			else {
+				frame.push_back((uint8_t)(hi << 4 | v));
+				hi = -1;
+			}
+		}
+		if (!frame.empty())
+			frames.push_back(frame);
+	}
+
+	fclose(f);
+	return true;
+}
+
+// Where -o sends the capture.
+class FilePrint : public Print
+{
+	public:
+		FilePrint(FILE *f) : f(f) {}
+		size_t write(uint8_t c) { return fputc(c, f) == EOF ? 0 : 1; }
+		size_t write(const uint8_t *buffer, size_t size) { return fwrite(buffer, 1, size, f); }
+
+	private:
+		FILE *f;
+};
+
+// Counts the events processPacket() delivers, by type.
+class EventCounter : public RAMSESSubscriber
+{
+	public:
+		EventCounter() : fanSetting(0), fanTimer(0), fanStatus(0), unknown(0) {}
+		void onFanSetting(const RAMSESFanSettingCommand &) { fanSetting++; }
+		void onFanTimer(const RAMSESFanTimerCommand &) { fanTimer++; }
+		void onFanStatus(const RAMSESFanStatus &) { fanStatus++; }
+		void onUnknown(const RAMSESUnknownMessage &) { unknown++; }
+
+		unsigned long fanSetting, fanTimer, fanStatus, unknown;
+};
+
+static int referenceDecode(RAMSES &rf, const CC1101Packet *packet, RAMSESMessage *msg)
+{
+	static bitbuffer_t bits;
+	int err = rf.messageDecodeReference(packet, &bits);
+	if (err <= 0)
+		return err;
+	err = rf.messageParseReference(&bits, msg);
+	return err <= 0 ? err : 1;
+}
+
+static bool sameFields(const RAMSESMessage *a, const RAMSESMessage *b)
+{
+	if (a->header != b->header || a->num_device_ids != b->num_device_ids
+			|| a->command != b->command || a->payload_length != b->payload_length
+			|| a->crc != b->crc)
+		return false;
+	for (unsigned i = 0; i < a->num_device_ids; i++)
+		if (memcmp(a->device_id[i], b->device_id[i], 3))
+			return false;
+	return memcmp(a->payload(), b->payload(), a->payload_length) == 0;
+}
+
+// Feed a frame to the streaming decoder in chunks of the given size, as
+// RAMSES::receivePacket() does while it is coming in.
+// The receiver stops reading at the end of the trailer symbol, so the 0x55
+// symbols after it are not checked; *length is set to what it would read.
+static int streamDecode(RAMSES &rf, const CC1101Packet *packet, unsigned chunk, RAMSESMessage *msg, uint8_t *length, uint8_t *reason)
+{
+	RAMSESStreamDecoder decoder;
+	int err = 0;
+
+	for (unsigned i = 0; i < packet->length && err == 0; i += chunk) {
+		unsigned n = packet->length - i < chunk ? packet->length - i : chunk;
+		err = decoder.feed(&packet->data[i], n);
+	}
+	*length = decoder.frameLength() && decoder.frameLength() < packet->length ? decoder.frameLength() : packet->length;
+	*reason = err < 0 ? decoder.rejectReason() : err == 0 ? (uint8_t)RAMSES_STAT_TRAILER : (uint8_t)RAMSES_STATS;
+	if (err <= 0)
+		return err;
+	err = rf.messageParse(decoder.message(), decoder.messageLength(), msg);
+	return err <= 0 ? err : 1;
+}
+
+// xorshift32, so a seed gives the same fuzz set everywhere
+static uint32_t fuzzNext(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+#define FUZZ_FRAMES 3000
+
+// Bits [from, from + count) of in to bit at of out, MSB first.
+static void copyBits(const uint8_t *in, unsigned from, unsigned count, uint8_t *out, unsigned at)
+{
+	for (unsigned i = 0; i < count; i++) {
+		uint8_t mask = 0x80 >> ((at + i) % 8);
+		if (bitrow_get_bit(in, from + i))
+			out[(at + i) / 8] |= mask;
+		else
+			out[(at + i) / 8] &= ~mask;
+	}
+}
+
+// Drop message bytes [first, first + drop) of an encoded frame and repeat
+// the next repeat ones, keeping the symbol framing intact: past the 17 bit
+// preamble pattern and the 3 header symbols, each byte is 20 bits.
+static frame_t spliceBytes(const frame_t &frame, unsigned first, unsigned drop, unsigned repeat)
+{
+	const unsigned start = 17 + 30, bits = 8 * frame.size();
+	unsigned from = start + 20 * first, rest = from + 20 * drop;
+	frame_t out(sizeof(((CC1101Packet *)0)->data), 0);
+	unsigned at = 0;
+
+	if (rest + 20 * repeat > bits)
+		return frame;
+	copyBits(frame.data(), 0, from, out.data(), at);
+	at += from;
+	for (unsigned r = 0; r < repeat && at + 40 <= 8 * out.size(); r++, at += 20)
+		copyBits(frame.data(), rest, 20, out.data(), at);
+	unsigned tail = bits - rest < 8 * out.size() - at ? bits - rest : 8 * out.size() - at;
+	copyBits(frame.data(), rest, tail, out.data(), at);
+	out.resize((at + tail + 7) / 8);
+	return out;
+}
+
+// Frames for -z: each starts as a loaded frame, a message with random fields
+// or noise, and most are damaged after that.
+static void fuzzFrames(RAMSES &rf, uint32_t seed, std::vector<frame_t> &frames)
+{
+	static const uint8_t headers[] = { 0x14, 0x18, 0x1c, 0x10, 0x3c };
+	static const uint16_t opcodes[] = { 0x22F1, 0x22F3, 0x31D9, 0x1FC9, 0x31E0 };
+	std::vector<frame_t> samples(frames);
+	uint32_t state = seed ? seed : 1;
+	static RAMSESMessage msg;
+
+	frames.clear();
+	while (frames.size() < FUZZ_FRAMES) {
+		frame_t frame;
+		uint32_t kind = fuzzNext(&state) % 8;
+
+		if (kind == 0) {
+			frame.resize(1 + fuzzNext(&state) % 63);
+			for (size_t i = 0; i < frame.size(); i++)
+				frame[i] = fuzzNext(&state);
+		}
+		else if (kind <= 2 && !samples.empty()) {
+			frame = samples[fuzzNext(&state) % samples.size()];
+		}
+		else {
+			memset(&msg, 0, sizeof(msg));
+			msg.num_device_ids = fuzzNext(&state) % (RAMSES_MAX_DEVICE_IDS + 1);
+			// the header byte usually, not always, agrees with the IDs that follow it
+			msg.header = fuzzNext(&state) % 4 ? headers[fuzzNext(&state) % sizeof(headers)] : fuzzNext(&state);
+			for (unsigned i = 0; i < msg.num_device_ids; i++)
+				for (unsigned j = 0; j < 3; j++)
+					msg.device_id[i][j] = fuzzNext(&state);
+			msg.command = fuzzNext(&state) % 2 ? opcodes[fuzzNext(&state) % (sizeof(opcodes) / sizeof(opcodes[0]))] : fuzzNext(&state);
+			msg.layoutPayload();
+			unsigned room = RAMSES_MESSAGE_MAX - 1 - msg.payload_offset;
+			msg.payload_length = fuzzNext(&state) % (room + 1);
+			if (fuzzNext(&state) % 4 == 0)
+				msg.unparsed_length = fuzzNext(&state) % (room - msg.payload_length + 1);
+			msg.unparsed_offset = msg.payload_offset + msg.payload_length;
+			for (unsigned i = msg.payload_offset; i < RAMSES_MESSAGE_MAX; i++)
+				msg.frame[i] = fuzzNext(&state);
+
+			CC1101Packet encoded;
+			uint8_t len = rf.messageEncode(&msg, &encoded);
+			if (len <= 8)
+				continue;
+			// what the receiver's FIFO gets: everything after the sync word, padded as a fixed length recording
+			frame.assign(encoded.data + 8, encoded.data + len);
+			// whole message bytes missing or repeated: an empty message, or the trailer off where the length puts it
+			if (fuzzNext(&state) % 4 == 0) {
+				unsigned bytes = msg.unparsed_offset + msg.unparsed_length + 1;
+				unsigned first = fuzzNext(&state) % (bytes + 1);
+				switch (fuzzNext(&state) % 3) {
+				case 0: frame = spliceBytes(frame, 0, bytes, 0); break;
+				case 1: frame = spliceBytes(frame, first, fuzzNext(&state) % (bytes - first + 1), 0); break;
+				default: frame = spliceBytes(frame, first, 0, 1 + fuzzNext(&state) % 4);
+				}
+			}
+			if (fuzzNext(&state) % 2 && frame.size() < 63)
+				frame.resize(63, 0);
+		}
+
+		switch (fuzzNext(&state) % 6) {
+			case 0:
+			case 1:
+				break;
+			case 2:
+				for (uint32_t n = 1 + fuzzNext(&state) % 3; n; n--)
+					frame[fuzzNext(&state) % frame.size()] ^= 1 << fuzzNext(&state) % 8;
+				break;
+			case 3:
+				frame[fuzzNext(&state) % frame.size()] = fuzzNext(&state);
+				break;
+			case 4:
+				frame.resize(1 + fuzzNext(&state) % frame.size());
+				break;
+			case 5:
+				if (frame.size() < sizeof(((CC1101Packet *)0)->data))
+					frame.insert(frame.begin() + fuzzNext(&state) % frame.size(), (uint8_t)fuzzNext(&state));
+				break;
+		}
+		frames.push_back(frame);
+	}
+}
+
+// A frame the single pass decoder found further in: the stream decoder,
+// started at each bit from there, has to read the same message.
+static bool latePreamble(RAMSES &rf, const CC1101Packet *packet, const RAMSESMessage *read)
+{
+	static RAMSESMessage stream;
+	CC1101Packet shifted;
+
+	for (unsigned skip = 1; skip + 8 * 8 < 8 * packet->length; skip++) {
+		shifted.length = (8 * packet->length - skip) / 8;
+		copyBits(packet->data, skip, 8 * shifted.length, shifted.data, 0);
+		memset(&stream, 0, sizeof(stream));
+		uint8_t length, reason;
+		if (streamDecode(rf, &shifted, 8, &stream, &length, &reason) == 1 && sameFields(read, &stream))
+			return true;
+	}
+	return false;
+}
+
+// Decode every frame with both decoders. The single pass decoder is stricter
+// in one respect: it rejects frames whose length fields overrun the
+// message, which the reference parses into garbage; those are counted
+// separately rather than as differences. The streaming decoder, fed in
+// chunks of 1 to 16 bytes, has to agree with the single pass decoder (on
+// the bytes the receiver reads) on which frames are good and what is in them.
+// It only looks for the preamble at the start, where the receiver's sync
+// word leaves it; frames that have it further in are retried from there and
+// counted as late rather than as differences.
+static int differential(RAMSES &rf, const std::vector<frame_t> &frames)
+{
+	static RAMSESMessage ref, msg, stream, read;
+	unsigned long same = 0, stricter = 0, differ = 0, streamDiffer = 0, late = 0;
+	unsigned long rejects[RAMSES_STATS + 1] = { 0 };
+
+	for (size_t f = 0; f < frames.size(); f++) {
+		CC1101Packet packet;
+		packet.length = frames[f].size();
+		memcpy(packet.data, frames[f].data(), packet.length);
+
+		memset(&ref, 0, sizeof(ref));
+		memset(&msg, 0, sizeof(msg));
+		memset(&stream, 0, sizeof(stream));
+		memset(&read, 0, sizeof(read));
+		int a = referenceDecode(rf, &packet, &ref);
+		int b = rf.messageDecode(&packet, &msg);
+		if (b > 0)
+			b = 1;
+		uint8_t length, reason;
+		int c = streamDecode(rf, &packet, f % 16 + 1, &stream, &length, &reason);
+		rejects[reason]++;
+		CC1101Packet received = packet;
+		received.length = length;
+		int d = rf.messageDecode(&received, &read);
+		if (d > 0)
+			d = 1;
+
+		if (a == 1 && b == 1 && sameFields(&ref, &msg)) {
+			same++;
+		}
+		else if (a != 1 && a == b) {
+			same++;
+		}
+		else if (a == 1 && b == -4) { // DECODE_FAIL_SANITY
+			stricter++;
+		}
+		else {
+			differ++;
+			fprintf(stderr, "frame %zu: reference %d, single pass %d\n", f, a, b);
+		}
+
+		if (d == 1 && c != 1 && reason == RAMSES_STAT_PREAMBLE && latePreamble(rf, &received, &read)) {
+			late++;
+		}
+		else if ((d == 1) != (c == 1) || (d == 1 && !sameFields(&read, &stream))) {
+			streamDiffer++;
+			fprintf(stderr, "frame %zu: single pass %d, streaming %d\n", f, d, c);
+		}
+	}
+
+	fprintf(stderr, "frames:            %zu (%lu same, %lu rejected as insane, %lu different, %lu different when streamed, %lu preamble late)\n",
+			frames.size(), same, stricter, differ, streamDiffer, late);
+	fprintf(stderr, "stream rejects:    %lu preamble, %lu header, %lu manchester, %lu trailer, %lu length, %lu checksum\n",
+			rejects[RAMSES_STAT_PREAMBLE], rejects[RAMSES_STAT_HEADER], rejects[RAMSES_STAT_MANCHESTER],
+			rejects[RAMSES_STAT_TRAILER], rejects[RAMSES_STAT_LENGTH], rejects[RAMSES_STAT_MIC]);
+	return differ || streamDiffer ? 1 : 0;
+}
+
+// Bits of a frame from the start of the RX view through the 0x35 trailer:
+// the 17 bit preamble pattern, the 3 header symbols, two symbols per message
+// byte (checksum included) and the trailer symbol.
+static unsigned frameBits(const RAMSESMessage *msg)
+{
+	unsigned bytes = 1 + 3 * msg->num_device_ids + 3 + msg->payload_length + msg->unparsed_length + 1;
+	return 17 + 10 * (3 + 2 * bytes + 1);
+}
+
+static bool sameBits(const uint8_t *a, const uint8_t *b, unsigned bits)
+{
+	if (memcmp(a, b, bits / 8))
+		return false;
+	uint8_t mask = 0xFF << (8 - bits % 8);
+	return bits % 8 == 0 || ((a[bits / 8] ^ b[bits / 8]) & mask) == 0;
+}
+
+// The encoded bits anywhere in the recording: noise may come before the preamble.
+static bool foundBits(const uint8_t *recording, unsigned length, const uint8_t *bits, unsigned count)
+{
+	uint8_t shifted[sizeof(((CC1101Packet *)0)->data)];
+
+	for (unsigned skip = 0; skip + count <= length; skip++) {
+		copyBits(recording, skip, count, shifted, 0);
+		if (sameBits(shifted, bits, count))
+			return true;
+	}
+	return false;
+}
+
+// Encode every frame messageDecode() accepts and check the result decodes to
+// the same message, bit for bit as it was received. Unparsed trailing bytes
+// are only compared for the single pass decoder; the reference does not
+// extract them reliably.
+static int roundTrip(RAMSES &rf, const std::vector<frame_t> &frames)
+{
+	static RAMSESMessage msg, again, ref;
+	unsigned long decoded = 0, failed = 0;
+
+	for (size_t f = 0; f < frames.size(); f++) {
+		CC1101Packet packet, encoded, rx;
+		packet.length = frames[f].size();
+		memcpy(packet.data, frames[f].data(), packet.length);
+
+		memset(&msg, 0, sizeof(msg));
+		if (rf.messageDecode(&packet, &msg) <= 0)
+			continue;
+		decoded++;
+
+		uint8_t len = rf.messageEncode(&msg, &encoded);
+
+		// what the receiver's FIFO gets: everything after the sync word, at least 63 bytes
+		rx.length = len - 8 > 63 ? len - 8 : 63;
+		if (len > 8)
+			memcpy(rx.data, &encoded.data[8], len - 8);
+
+		memset(&again, 0, sizeof(again));
+		memset(&ref, 0, sizeof(ref));
+		const char *why = NULL;
+		if (len == 0)
+			why = "does not fit";
+		else if (rf.messageDecode(&rx, &again) <= 0 || !sameFields(&msg, &again)
+				|| msg.unparsed_length != again.unparsed_length
+				|| memcmp(msg.unparsed(), again.unparsed(), msg.unparsed_length))
+			why = "single pass decode differs";
+		else if (referenceDecode(rf, &rx, &ref) != 1 || !sameFields(&msg, &ref))
+			why = "reference decode differs";
+		else if (!foundBits(packet.data, 8 * packet.length, rx.data, frameBits(&msg)))
+			why = "bits differ";
+
+		if (why) {
+			failed++;
+			fprintf(stderr, "frame %zu: %s\n", f, why);
+		}
+	}
+
+	fprintf(stderr, "frames:            %zu (%lu decoded, %lu round trip failures)\n",
+			frames.size(), decoded, failed);
+	return failed ? 1 : 0;
+}
+
+static const char *sentIntact(CC1101Emulator &radio, const CC1101Packet &packet)
+{
+	bool intact = !radio.sent().empty() && radio.sent().back().size() == packet.length
+			&& memcmp(radio.sent().back().data(), packet.data, packet.length) == 0;
+	return intact ? "sent intact" : "NOT sent intact";
+}
+
+static void spiCost(CC1101Emulator &radio, RAMSES &rf)
+{
+	radio.resetStats();
+	rf.initReceive();
+	fprintf(stderr, "SPI per initReceive: %lu transactions (%lu polling), %lu bytes\n",
+			radio.stats().spiTransactions, radio.stats().pollTransactions, radio.stats().spiBytes);
+
+	CC1101Packet packet;
+	packet.length = 100;
+	for (unsigned i = 0; i < packet.length; i++)
+		packet.data[i] = i;
+
+	for (int fast = 0; fast < 2; fast++) {
+		rf.setFastTurnaround(fast);
+		radio.resetStats();
+		rf.sendPacket(&packet);
+		fprintf(stderr, "%s turnaround:     RX->TX %u us, TX->RX %u us, %lu transactions besides polling (%s)\n",
+				fast ? "fast" : "slow", rf.getTurnaroundRxTx(), rf.getTurnaroundTxRx(),
+				radio.stats().spiTransactions - radio.stats().pollTransactions, sentIntact(radio, packet));
+	}
+
+	// the first of each command is encoded, repeats come from the cache and
+	// must go on the air exactly as the first one did
+	IthoCommand commands[] = { IthoHigh, IthoLow, IthoHigh, IthoJoin, IthoHigh };
+	const unsigned numCommands = sizeof(commands) / sizeof(commands[0]);
+	rf.setSendTries(1);
+	size_t first = radio.sent().size();
+	for (unsigned i = 0; i < numCommands; i++)
+		rf.sendCommand(commands[i]);
+	bool same = radio.sent().size() == first + numCommands;
+	for (unsigned i = 0; same && i < numCommands; i++)
+		for (unsigned j = 0; j < i; j++)
+			if (commands[i] == commands[j] && radio.sent()[first + i] != radio.sent()[first + j])
+				same = false;
+	fprintf(stderr, "sendCommand:         %u encoded, %u from the cache (%s)\n",
+			rf.getTxCacheMisses(), rf.getTxCacheHits(), same ? "repeats identical" : "repeats DIFFER");
+
+	// no frame is known for these, nothing may go on the air
+	size_t before = radio.sent().size();
+	rf.sendCommand(IthoStandby);
+	rf.sendCommand(IthoUnknown);
+	fprintf(stderr, "sendCommand:         standby/unknown %s\n",
+			radio.sent().size() == before ? "not sent" : "SENT");
+
+	CC1101 chip;
+
+	// infinite packet length, the packet ends when the TX FIFO runs dry
+	chip.writeRegister(CC1101_PKTCTRL0, 0x02);
+	radio.resetStats();
+	chip.sendData(&packet);
+	const CC1101Emulator::Stats &st = radio.stats();
+	fprintf(stderr, "SPI per sendData:    %lu transactions (%lu polling), %lu bytes (%u byte packet, %s)\n",
+			st.spiTransactions, st.pollTransactions, st.spiBytes, packet.length, sentIntact(radio, packet));
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long iterations = 1;
+	unsigned loops = 4;
+	unsigned gap = 20;
+	unsigned repeats = 1;
+	unsigned every = 1;
+	bool interrupt = false;
+	bool threaded = false;
+	bool quiet = false;
+	bool compare = false;
+	bool encode = false;
+	bool cost = false;
+	bool everyCopy = false;
+	int logLevel = -1;
+	const char *capturePath = NULL;
+	bool fuzz = false;
+	uint32_t fuzzSeed = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:l:g:r:w:itqdesuv:o:z:")) != -1) {
+		switch (opt) {
+			case 'n':
+				iterations = strtoul(optarg, NULL, 0);
+				break;
+			case 'l':
+				loops = strtoul(optarg, NULL, 0);
+				break;
+			case 'g':
+				gap = strtoul(optarg, NULL, 0);
+				break;
+			case 'r':
+				repeats = strtoul(optarg, NULL, 0);
+				break;
+			case 'w':
+				every = strtoul(optarg, NULL, 0);
+				if (every == 0)
+					every = 1;
+				break;
+			case 'i':
+				interrupt = true;
+				break;
+			case 't':
+				threaded = true;
+				break;
+			case 'q':
+				quiet = true;
+				break;
+			case 'd':
+				compare = true;
+				break;
+			case 'e':
+				encode = true;
+				break;
+			case 's':
+				cost = true;
+				break;
+			case 'u':
+				everyCopy = true;
+				break;
+			case 'v':
+				logLevel = strtol(optarg, NULL, 0);
+				break;
+			case 'o':
+				capturePath = optarg;
+				break;
+			case 'z':
+				fuzz = true;
+				fuzzSeed = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n iterations] [-l loops] [-g gap] [-r repeats] [-w every] [-i] [-t] [-q] [-d] [-e] [-s] [-u] [-v level] [-o capture] [-z seed] [frames.txt|capture]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	const char *path = optind < argc ? argv[optind] : RAMSES_SAMPLE_FRAMES;
+	std::vector<frame_t> frames;
+	if (!loadFrames(path, frames) || frames.empty()) {
+		fprintf(stderr, "%s: no frames in %s\n", argv[0], path);
+		return 1;
+	}
+
+	CC1101Emulator radio;
+	SPI.attach(&radio);
+
+	RAMSES rf;
+	rf.init();
+
+	if (fuzz) {
+		fuzzFrames(rf, fuzzSeed, frames);
+		fprintf(stderr, "fuzz:              %zu frames from seed %u\n", frames.size(), fuzzSeed);
+	}
+
+	if (quiet || compare || encode || cost)
+		Serial.setOutput(NULL);
+	if (compare)
+		return differential(rf, frames);
+	if (encode)
+		return roundTrip(rf, frames);
+	if (cost) {
+		spiCost(radio, rf);
+		return 0;
+	}
+
+	if (everyCopy)
+		rf.setDedupWindow(0);
+	if (logLevel >= 0)
+		rf.setLogLevel(logLevel);
+	RAMSESEventPrinter printer;
+	EventCounter events;
+	if (!quiet)
+		rf.subscribe(&printer);
+	rf.subscribe(&events);
+	if (interrupt) {
+		radio.connectGdo(2, IRQ_PIN);
+		rf.enableInterrupt(IRQ_PIN);
+	}
+	FILE *captureFile = NULL;
+	FilePrint *captureOut = NULL;
+	RAMSESRecorder *recorder = NULL;
+	if (capturePath) {
+		captureFile = fopen(capturePath, "wb");
+		if (!captureFile) {
+			fprintf(stderr, "%s: cannot write %s\n", argv[0], capturePath);
+			return 1;
+		}
+		captureOut = new FilePrint(captureFile);
+		recorder = new RAMSESRecorder(*captureOut);
+		rf.setRecorder(recorder);
+	}
+
+	radio.resetStats();
+	uint32_t spiBefore = rf.getSpiTransactions();
+	std::atomic<unsigned long> accepted(0);
+	std::atomic<bool> done(false);
+	std::thread decoder, reader;
+	unsigned long snapshotReads = 0, snapshotRetries = 0, snapshotTorn = 0;
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	if (threaded) {
+		decoder = std::thread([&]() {
+			for (;;) {
+				bool last = done.load();
+				if (rf.processPacket())
+					accepted++;
+				else if (last)
+					break;
+				else
+					std::this_thread::yield();
+			}
+		});
+		// what a web or MQTT task would do: look at the last message in place,
+		// which has to sum to 0 whenever valid() says it was not overwritten
+		reader = std::thread([&]() {
+			const SeqlockSnapshot<RAMSESLastMessage> &snapshot = rf.getLastSnapshot();
+			while (!done.load()) {
+				uint32_t token;
+				const RAMSESLastMessage *last = snapshot.read(&token);
+				if (last) {
+					uint8_t sum = 0;
+					for (unsigned i = 0; i < last->message.frame_length && i < RAMSES_MESSAGE_MAX; i++)
+						sum += last->message.frame[i];
+					bool intact = last->message.frame_length > 0 && sum == 0;
+					if (!snapshot.valid(token))
+						snapshotRetries++;
+					else if (!intact)
+						snapshotTorn++;
+					else
+						snapshotReads++;
+				}
+				std::this_thread::yield();
+			}
+		});
+	}
+	std::function<void()> loop = [&]() {
+		for (unsigned l = 0; l < loops; l++) {
+			if (threaded)
+				rf.receivePacket();
+			else if (rf.checkForNewPacket())
+				accepted++;
+		}
+		if (!quiet)
+			rf.printLog();
+		if (recorder)
+			recorder->drain();
+		// a byte-time is ~200us on the air; let the decoder have some of it
+		if (threaded)
+			std::this_thread::yield();
+	};
+	for (unsigned long i = 0; i < iterations; i++) {
+		for (size_t f = 0; f < frames.size(); f++) {
+			for (unsigned r = 0; r < repeats; r++)
+				radio.queueFrame(frames[f].data(), frames[f].size(), gap);
+			for (unsigned long t = 1; !radio.airIdle(); t++) {
+				radio.air(1);
+				if (t % every == 0)
+					loop();
+			}
+			// whatever the last frame left in the FIFO
+			loop();
+		}
+	}
+
+	if (threaded) {
+		done.store(true);
+		decoder.join();
+		reader.join();
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	unsigned long total = iterations * frames.size() * repeats;
+	double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+	const CC1101Emulator::Stats &st = radio.stats();
+	uint32_t received = rf.getPacketsReceived();
+
+	fprintf(stderr, "frames:            %lu (%lu accepted, %u retransmissions suppressed, %lu missed by the radio)\n",
+			total, accepted.load(), rf.getFramesDuplicate(), st.framesMissed);
+	if (st.rxFifoErrata)
+		fprintf(stderr, "RX FIFO errata:    %lu bytes read twice, the FIFO was read empty while a packet came in\n", st.rxFifoErrata);
+	fprintf(stderr, "time per frame:    %.0f ns\n", ns / total);
+	fprintf(stderr, "SPI per frame:     %.1f transactions, %.1f bytes\n",
+			(double)st.spiTransactions / total, (double)st.spiBytes / total);
+	fprintf(stderr, "SPI per received:  %.1f transactions (%s, %u packets read, %u back to back)\n",
+			received ? (double)(rf.getSpiTransactions() - spiBefore) / received : 0.0,
+			interrupt ? "GDO2 interrupt" : "polling", received, rf.getFramesBackToBack());
+	if (threaded)
+		fprintf(stderr, "decoder thread:    %u dropped, ring high water %u/%u\n",
+				rf.getFramesDropped(), rf.getRingHighWater(), RAMSES_RX_RING_SIZE);
+	if (threaded)
+		fprintf(stderr, "snapshot reader:   %lu reads, %lu retried, %lu torn\n",
+				snapshotReads, snapshotRetries, snapshotTorn);
+	if (!quiet)
+		rf.printLog();
+	if (!quiet)
+		rf.printLatency();
+	if (!quiet)
+		rf.printStats();
+	if (recorder) {
+		rf.setRecorder(NULL);
+		while (recorder->drain())
+			;
+		fprintf(stderr, "capture:           %u records (%u dropped), %ld bytes to %s\n",
+				recorder->getRecorded(), recorder->getDropped(), ftell(captureFile), capturePath);
+		fclose(captureFile);
+		delete recorder;
+		delete captureOut;
+	}
+	const RAMSESStats &quality = rf.getStats();
+	fprintf(stderr, "receive quality:   %u parsed, %u rejected (", quality.get(RAMSES_STAT_PARSED), quality.getRejected());
+	for (uint8_t i = RAMSES_STAT_FIRST_REJECT; i < RAMSES_STATS; i++)
+		fprintf(stderr, "%s%u %s", i == RAMSES_STAT_FIRST_REJECT ? "" : ", ", quality.get(i), RAMSESStats::name(i));
+	fprintf(stderr, "), %u ring full, %u FIFO overflows, %u bytes\n",
+			quality.get(RAMSES_STAT_RING_FULL), quality.get(RAMSES_STAT_FIFO_OVERFLOW), quality.get(RAMSES_STAT_BYTES));
+	fprintf(stderr, "events:            %lu fan setting, %lu fan timer, %lu fan status, %lu other\n",
+			events.fanSetting, events.fanTimer, events.fanStatus, events.unknown);
+	char line[128];
+	rf.LastMessageDecoded(line, sizeof(line));
+	fprintf(stderr, "last message:      %s\n", line);
+	const RAMSESDevices &devices = rf.getDevices();
+	fprintf(stderr, "devices:           %u/%u (%u frames untracked)\n",
+			devices.size(), devices.capacity(), devices.getUntracked());
+	devices.forEach([](const RAMSESDevice &d) {
+		fprintf(stderr, "  %02u:%06u  %6u frames %u errors  rssi %02X lqi %u  fan %02X\n",
+				d.type(), d.number(), d.frames, d.errors, d.rssi, d.lqi, d.fanSetting);
+	});
+
+	return st.rxFifoErrata ? 1 : 0;
+}
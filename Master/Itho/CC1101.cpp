@@ -2,10 +2,13 @@
  * Author: Klusjesman, modified bij supersjimmie for Arduino/ESP8266
  */
 
+#include <string.h>
 #include "CC1101.h"
+#include "CC1101Profile.h"
 
 // default constructor
-CC1101::CC1101()
+CC1101::CC1101() : spiSettings(CC1101_SPI_CLOCK, MSBFIRST, SPI_MODE0), selected(false),
+	batching(false), batchLength(0), spiTransactions(0), chipStatus(0)
 {
 	SPI.begin();
 #if defined(ESP8266) || defined(ESP32)
@@ -21,11 +24,28 @@ CC1101::~CC1101()
 /***********************/
 // SPI helper functions select() and deselect()
 inline void CC1101::select(void) {
+	spiTransactions++;
+	if (!selected)
+		SPI.beginTransaction(spiSettings);
+	selected = true;
 	digitalWrite(SS, LOW);
 }
 
 inline void CC1101::deselect(void) {
 	digitalWrite(SS, HIGH);
+	if (selected)
+		SPI.endTransaction();
+	selected = false;
+}
+
+//clock out data, replacing it with what was clocked in, as one transfer (DMA where the core supports it)
+void CC1101::transferBytes(uint8_t* data, uint8_t length)
+{
+#if defined(ESP8266) || defined(ESP32) || defined(ARDUINO_ARCH_HOST)
+	SPI.transferBytes(data, data, length);
+#else
+	SPI.transfer(data, length);
+#endif
 }
 
 void CC1101::spi_waitMiso()
@@ -55,24 +75,79 @@ void CC1101::reset()
 	deselect();
 }
 
+/***********************/
+// Batched access: between beginBatch() and endBatch() strobes and single
+// register writes are queued and go out back to back in one chip select
+// assertion. A burst only ends when CSn goes high, so a burst write closes
+// the batch, and reads flush it first so they see the writes before them.
+void CC1101::beginBatch()
+{
+	batching = true;
+}
+
+void CC1101::endBatch()
+{
+	flushBatch();
+	batching = false;
+}
+
+void CC1101::flushBatch()
+{
+	if (batchLength == 0)
+		return;
+
+	select();
+	spi_waitMiso();
+	transferBytes(batch, batchLength);
+	deselect();
+
+	//only strobes and writes are batched, so every byte is answered with the status byte
+	chipStatus = batch[batchLength - 1];
+	batchLength = 0;
+}
+
+uint8_t *CC1101::batchReserve(uint8_t length)
+{
+	uint8_t *p;
+
+	if (batchLength + length > CC1101_BATCH_SIZE)
+		flushBatch();
+	p = &batch[batchLength];
+	batchLength += length;
+	return p;
+}
+
 uint8_t CC1101::writeCommand(uint8_t command)
 {
 	uint8_t result;
 
+	if (batching) {
+		*batchReserve(1) = command;
+		return 0;
+	}
+
 	select();
 	spi_waitMiso();
 	result = SPI.transfer(command);
 	deselect();
 
+	chipStatus = result;
 	return result;
 }
 
 void CC1101::writeRegister(uint8_t address, uint8_t data)
 {
+	if (batching) {
+		uint8_t *p = batchReserve(2);
+		p[0] = address;
+		p[1] = data;
+		return;
+	}
+
 	select();
 	spi_waitMiso();
 	SPI.transfer(address);
-	SPI.transfer(data);
+	chipStatus = SPI.transfer(data);
 	deselect();
 }
 
@@ -80,9 +155,10 @@ uint8_t CC1101::readRegister(uint8_t address)
 {
 	uint8_t val;
 
+	flushBatch();
 	select();
 	spi_waitMiso();
-	SPI.transfer(address);
+	chipStatus = SPI.transfer(address);
 	val = SPI.transfer(0);
 	deselect();
 
@@ -93,6 +169,7 @@ uint8_t CC1101::readRegisterMedian3(uint8_t address)
 {
   uint8_t val, val1, val2, val3;
 
+  flushBatch();
   select();
   spi_waitMiso();
   SPI.transfer(address);
@@ -132,6 +209,34 @@ uint8_t /* ICACHE_RAM_ATTR */ CC1101::readRegisterWithSyncProblem(uint8_t addres
 	return value1;
 }
 
+/* The status byte has the same synchronization problem while the chip is
+active, but it comes back for every header byte, so the SNOPs can be
+repeated until two agree without releasing chip select. In IDLE it is
+stable and the first one is taken as is. */
+uint8_t CC1101::readStatus(bool rxFifo)
+{
+	uint8_t header = CC1101_SNOP | (rxFifo ? CC1101_READ_SINGLE : 0);
+	uint8_t value1, value2;
+
+	flushBatch();
+	select();
+	spi_waitMiso();
+	value1 = SPI.transfer(header);
+	if ((value1 & CC1101_STATUS_STATE_BM) != CC1101_STATE_IDLE)
+	{
+		do
+		{
+			value2 = value1;
+			value1 = SPI.transfer(header);
+		}
+		while (value1 != value2);
+	}
+	deselect();
+
+	chipStatus = value1;
+	return value1;
+}
+
 //registerType = CC1101_CONFIG_REGISTER or CC1101_STATUS_REGISTER
 uint8_t CC1101::readRegister(uint8_t address, uint8_t registerType)
 {
@@ -150,30 +255,46 @@ uint8_t CC1101::readRegister(uint8_t address, uint8_t registerType)
 	}
 }
 
-void CC1101::writeBurstRegister(uint8_t address, uint8_t* data, uint8_t length)
+void CC1101::writeBurstRegister(uint8_t address, const uint8_t* data, uint8_t length)
 {
-	uint8_t i;
+	if (batching && length < CC1101_BATCH_SIZE) {
+		uint8_t *p = batchReserve(length + 1);
+		p[0] = address | CC1101_WRITE_BURST;
+		memcpy(p + 1, data, length);
+		flushBatch();
+		return;
+	}
 
+	flushBatch();
 	select();
 	spi_waitMiso();
-	SPI.transfer(address | CC1101_WRITE_BURST);
-	for (i = 0; i < length; i++) {
-		SPI.transfer(data[i]);
+	chipStatus = SPI.transfer(address | CC1101_WRITE_BURST);
+	while (length) {
+		uint8_t chunk[CC1101_BATCH_SIZE];
+		uint8_t n = length < sizeof(chunk) ? length : sizeof(chunk);
+
+		memcpy(chunk, data, n);
+		transferBytes(chunk, n);
+		data += n;
+		length -= n;
 	}
 	deselect();
 }
 
-void CC1101::readBurstRegister(uint8_t* buffer, uint8_t address, uint8_t length)
+void CC1101::loadProfile(const CC1101Profile &profile)
 {
-	uint8_t i;
+	writeBurstRegister(0x00, profile.regs, CC1101_CONFIG_REGISTERS);
+}
 
+void CC1101::readBurstRegister(uint8_t* buffer, uint8_t address, uint8_t length)
+{
+	flushBatch();
 	select();
 	spi_waitMiso();
-	SPI.transfer(address | CC1101_READ_BURST);
+	chipStatus = SPI.transfer(address | CC1101_READ_BURST);
 
-	for (i = 0; i < length; i++) {
-		buffer[i] = SPI.transfer(0x00);
-	}
+	memset(buffer, 0, length);
+	transferBytes(buffer, length);
 
 	deselect();
 }
@@ -181,24 +302,32 @@ void CC1101::readBurstRegister(uint8_t* buffer, uint8_t address, uint8_t length)
 //wait for fixed length in rx fifo
 uint8_t CC1101::receiveData(CC1101Packet* packet, uint8_t length)
 {
-	uint8_t rxBytes = readRegisterWithSyncProblem(CC1101_RXBYTES, CC1101_STATUS_REGISTER);
-	rxBytes = rxBytes & CC1101_BITS_RX_BYTES_IN_FIFO;
+	uint8_t status = readStatus(true);
+	uint8_t rxBytes = status & CC1101_STATUS_FIFO_BYTES_AVAILABLE_BM;
+
+	//the status byte counts up to 15, only ask RXBYTES when that may not be all
+	if (rxBytes == CC1101_STATUS_FIFO_BYTES_AVAILABLE_BM && length > rxBytes)
+		rxBytes = readRegisterWithSyncProblem(CC1101_RXBYTES, CC1101_STATUS_REGISTER) & CC1101_BITS_RX_BYTES_IN_FIFO;
 
 	//check for rx fifo overflow
-	if ((readRegisterWithSyncProblem(CC1101_MARCSTATE, CC1101_STATUS_REGISTER) & CC1101_BITS_MARCSTATE) == CC1101_MARCSTATE_RXFIFO_OVERFLOW)
+	if ((status & CC1101_STATUS_STATE_BM) == CC1101_STATE_RX_OVERFLOW)
 	{
+		beginBatch();
 		writeCommand(CC1101_SIDLE);	//idle
 		writeCommand(CC1101_SFRX); //flush RX buffer
 		writeCommand(CC1101_SRX); //switch to RX state
+		endBatch();
 	}
 	else if (rxBytes == length)
 	{
 		readBurstRegister(packet->data, CC1101_RXFIFO, rxBytes);
 
 		//continue RX
+		beginBatch();
 		writeCommand(CC1101_SIDLE);	//idle
 		writeCommand(CC1101_SFRX); //flush RX buffer
 		writeCommand(CC1101_SRX); //switch to RX state
+		endBatch();
 
 		packet->length = rxBytes;
 	}
@@ -221,12 +350,15 @@ uint8_t CC1101::receiveData(CC1101Packet* packet, uint8_t length)
 void CC1101::sendData(CC1101Packet *packet)
 {
 	uint8_t index = 0;
-	uint8_t txStatus, MarcState;
+	uint8_t txStatus, chipState;
 	uint8_t length;
 
 	writeCommand(CC1101_SIDLE);		//idle
 
-	txStatus = readRegisterWithSyncProblem(CC1101_TXBYTES, CC1101_STATUS_REGISTER);
+	//idle now, so TXBYTES is stable and a single read will do
+	txStatus = readRegister(CC1101_TXBYTES | CC1101_STATUS_REGISTER);
+
+	beginBatch();
 
 	//clear TX fifo if needed
 	if (txStatus & CC1101_BITS_TX_FIFO_UNDERFLOW)
@@ -246,6 +378,8 @@ void CC1101::sendData(CC1101Packet *packet)
 	//start sending packet
 	writeCommand(CC1101_STX);
 
+	endBatch();
+
 	//continue sending when packet is bigger than 64 bytes
 	if (packet->length > CC1101_DATA_LEN)
 	{
@@ -254,16 +388,14 @@ void CC1101::sendData(CC1101Packet *packet)
 		//loop until all bytes are transmitted
 		while (index < packet->length)
 		{
-			//check if there is free space in the fifo
-			while ((txStatus = (readRegisterMedian3(CC1101_TXBYTES | CC1101_STATUS_REGISTER) & CC1101_BITS_RX_BYTES_IN_FIFO)) > (CC1101_DATA_LEN - 2));
+			//check if there is free space in the fifo (the status byte counts up to 15 free bytes)
+			while ((length = txFifoFree()) < 2);
 
 			//calculate how many bytes we can send
-			length = (CC1101_DATA_LEN - txStatus);
 			length = ((packet->length - index) < length ? (packet->length - index) : length);
 
 			//send some more bytes
-			for (int i=0; i<length; i++)
-				writeRegister(CC1101_TXFIFO, packet->data[index+i]);
+			writeBurstRegister(CC1101_TXFIFO, &packet->data[index], length);
 
 			index += length;
 		}
@@ -272,8 +404,8 @@ void CC1101::sendData(CC1101Packet *packet)
 	//wait until transmission is finished (TXOFF_MODE is expected to be set to 0/IDLE or TXFIFO_UNDERFLOW)
 	do
 	{
-		MarcState = (readRegisterWithSyncProblem(CC1101_MARCSTATE, CC1101_STATUS_REGISTER) & CC1101_BITS_MARCSTATE);
-//		if (MarcState == CC1101_MARCSTATE_TXFIFO_UNDERFLOW) Serial.print(F("TXFIFO_UNDERFLOW occured in sendData() \n"));
+		chipState = state();
+//		if (chipState == CC1101_STATE_TX_UNDERFLOW) Serial.print(F("TXFIFO_UNDERFLOW occured in sendData() \n"));
 	}
-  	while((MarcState != CC1101_MARCSTATE_IDLE) && (MarcState != CC1101_MARCSTATE_TXFIFO_UNDERFLOW));
+  	while((chipState != CC1101_STATE_IDLE) && (chipState != CC1101_STATE_TX_UNDERFLOW));
 }
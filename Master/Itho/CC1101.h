@@ -10,6 +10,14 @@
 #include <SPI.h>
 // On Arduino, SPI pins are predefined
 
+/*	SPI clock, burst access is specified up to 6.5MHz (10MHz for single access) */
+#ifndef CC1101_SPI_CLOCK
+#define CC1101_SPI_CLOCK						6500000
+#endif
+
+/*	Bytes queued between beginBatch() and endBatch() before they are sent */
+#define CC1101_BATCH_SIZE						64
+
 /*	Type of transfers */
 #define CC1101_WRITE_BURST						0x40
 #define CC1101_READ_SINGLE						0x80
@@ -89,6 +97,7 @@
 #define CC1101_TEST2							0x2C	// Various Test Settings
 #define CC1101_TEST1							0x2D	// Various Test Settings
 #define CC1101_TEST0							0x2E	// Various Test Settings
+#define CC1101_CONFIG_REGISTERS					0x2F	// Number of configuration registers, 0x00 - 0x2E
 
 /*	Status registers */
 #define CC1101_PARTNUM							0x30	// Chip ID
@@ -162,6 +171,8 @@ enum CC1101ChipStates
 
 
 
+struct CC1101Profile;
+
 class CC1101
 {
 	protected:
@@ -182,11 +193,28 @@ class CC1101
 		
 		uint8_t readRegister(uint8_t address, uint8_t registerType);
 				
-		void writeBurstRegister(uint8_t address, uint8_t* data, uint8_t length);
+		void writeBurstRegister(uint8_t address, const uint8_t* data, uint8_t length);
 		void readBurstRegister(uint8_t* buffer, uint8_t address, uint8_t length);
+
+		//all configuration registers in a single burst, see CC1101Profile.h
+		void loadProfile(const CC1101Profile &profile);
+
+		//queue commands and register writes, sent in a single transaction by endBatch() (or the next read)
+		void beginBatch();
+		void endBatch();
+
+		//chip status byte: status() is the last one the chip answered with (no SPI),
+		//state() and fifoBytes() fetch a fresh one with a single SNOP transaction
+		uint8_t status() const { return chipStatus; }
+		uint8_t state() { return readStatus(true) & CC1101_STATUS_STATE_BM; }
+		uint8_t fifoBytes() { return readStatus(true) & CC1101_STATUS_FIFO_BYTES_AVAILABLE_BM; }		//RX fifo, 15 means 15 or more
+		uint8_t txFifoFree() { return readStatus(false) & CC1101_STATUS_FIFO_BYTES_AVAILABLE_BM; }	//TX fifo, 15 means 15 or more
 		
 		void sendData(CC1101Packet *packet);
 		uint8_t receiveData(CC1101Packet* packet, uint8_t length);
+
+		//number of SPI transactions (chip select assertions) so far
+		uint32_t getSpiTransactions() const { return spiTransactions; }
 	
 	private:
 		CC1101( const CC1101 &c );
@@ -194,13 +222,28 @@ class CC1101
 		// SPI helper functions
 		void select(void);
 		void deselect(void);
+		void transferBytes(uint8_t* data, uint8_t length);
+		void flushBatch();
+		uint8_t *batchReserve(uint8_t length);
+
+		SPISettings spiSettings;
+		bool selected;
+
+		//batched transaction
+		bool batching;
+		uint8_t batch[CC1101_BATCH_SIZE];
+		uint8_t batchLength;
 		
 	protected:
 		uint8_t readRegister(uint8_t address);
 		uint8_t readRegisterMedian3(uint8_t address);
 		uint8_t readRegisterWithSyncProblem(uint8_t address, uint8_t registerType);
+		uint8_t readStatus(bool rxFifo);
 		
 		void reset();
+
+		uint32_t spiTransactions;
+		uint8_t chipStatus;
 		
 }; //CC1101
 
@@ -0,0 +1,157 @@
+/*
+ * CC1101 register images computed at compile time.
+ *
+ * A CC1101Settings names the radio parameters (carrier, data rate,
+ * deviation, bandwidth, sync word, packet handling, GDO signals, state machine);
+ * cc1101Profile() turns them into the values of all configuration registers
+ * 0x00-0x2E, so a mode is loaded with a single burst write
+ * (CC1101::loadProfile) and the derived register values can be checked with
+ * static_assert. The formulas are the ones from the CC1101 datasheet.
+ */
+
+#ifndef CC1101PROFILE_H_
+#define CC1101PROFILE_H_
+
+#include <stdint.h>
+#include "CC1101.h"
+
+#define CC1101_XOSC_HZ							26000000UL
+
+/*	MDMCFG2 MOD_FORMAT */
+#define CC1101_MOD_2FSK							0x00
+#define CC1101_MOD_GFSK							0x01
+#define CC1101_MOD_ASK_OOK						0x03
+#define CC1101_MOD_4FSK							0x04
+#define CC1101_MOD_MSK							0x07
+
+/*	MDMCFG2 SYNC_MODE */
+#define CC1101_SYNC_NONE						0x00
+#define CC1101_SYNC_15_16						0x01
+#define CC1101_SYNC_16_16						0x02
+#define CC1101_SYNC_30_32						0x03
+
+struct CC1101Settings
+{
+	uint32_t carrierHz;
+	uint32_t dataRate;			// baud
+	uint32_t deviationHz;
+	uint32_t rxBandwidthHz;		// the narrowest filter at least this wide is used
+	uint32_t channelSpacingHz;
+	uint8_t modulation;			// CC1101_MOD_*
+	uint8_t syncMode;			// CC1101_SYNC_*
+	uint16_t syncWord;
+	uint8_t preambleBytes;		// 2, 3, 4, 6, 8, 12, 16 or 24
+	uint8_t packetLength;		// PKTLEN
+	uint8_t pktctrl1;
+	uint8_t pktctrl0;
+	uint8_t iocfg2;
+	uint8_t iocfg1;
+	uint8_t iocfg0;
+	uint8_t mcsm1;
+	uint8_t mcsm0;
+	uint8_t paIndex;			// PATABLE entry used for TX (FREND0.PA_POWER)
+};
+
+struct CC1101Profile
+{
+	uint8_t regs[CC1101_CONFIG_REGISTERS];
+};
+
+// C++11 constexpr: one expression per function, loops become recursion
+namespace cc1101_profile {
+
+constexpr uint32_t ilog2(uint64_t x) { return x < 2 ? 0 : 1 + ilog2(x >> 1); }
+constexpr uint64_t divRound(uint64_t n, uint64_t d) { return (n + d / 2) / d; }
+
+// FREQ = f_carrier * 2^16 / f_xosc
+constexpr uint32_t freq(const CC1101Settings &s) { return divRound((uint64_t)s.carrierHz << 16, CC1101_XOSC_HZ); }
+
+// R_data = (256 + DRATE_M) * 2^DRATE_E * f_xosc / 2^28
+constexpr uint8_t drateE(const CC1101Settings &s) { return ilog2(((uint64_t)s.dataRate << 20) / CC1101_XOSC_HZ); }
+constexpr uint8_t drateM(const CC1101Settings &s) { return divRound((uint64_t)s.dataRate << 28, (uint64_t)CC1101_XOSC_HZ << drateE(s)) - 256; }
+
+// BW = f_xosc / (8 * (4 + CHANBW_M) * 2^CHANBW_E), index i = CHANBW_E * 4 + CHANBW_M narrows as it grows
+constexpr uint32_t chanbw(uint8_t i) { return CC1101_XOSC_HZ / ((8UL * (4 + (i & 3))) << (i >> 2)); }
+constexpr uint8_t chanbwIndex(uint32_t bw, uint8_t i) { return i == 0 || chanbw(i) >= bw ? i : chanbwIndex(bw, i - 1); }
+
+// f_dev = f_xosc / 2^17 * (8 + DEVIATION_M) * 2^DEVIATION_E
+constexpr uint32_t deviation(const CC1101Settings &s) { return divRound((uint64_t)s.deviationHz << 17, CC1101_XOSC_HZ); }
+constexpr uint8_t deviationE(const CC1101Settings &s) { return ilog2(deviation(s)) - 3; }
+constexpr uint8_t deviationM(const CC1101Settings &s) { return divRound(deviation(s), 1UL << deviationE(s)) - 8; }
+
+// channel spacing = f_xosc / 2^18 * (256 + CHANSPC_M) * 2^CHANSPC_E
+constexpr uint32_t chanspc(const CC1101Settings &s) { return divRound((uint64_t)s.channelSpacingHz << 18, CC1101_XOSC_HZ); }
+constexpr uint8_t chanspcE(const CC1101Settings &s) { return ilog2(chanspc(s)) - 8; }
+constexpr uint8_t chanspcM(const CC1101Settings &s) { return divRound(chanspc(s), 1UL << chanspcE(s)) - 256; }
+
+// NUM_PREAMBLE: 2, 3, 4, 6, 8, 12, 16, 24 bytes
+constexpr uint8_t numPreamble(uint8_t bytes)
+{
+	return bytes <= 2 ? 0 : bytes <= 3 ? 1 : bytes <= 4 ? 2 : bytes <= 6 ? 3 :
+	       bytes <= 8 ? 4 : bytes <= 12 ? 5 : bytes <= 16 ? 6 : 7;
+}
+
+constexpr uint8_t mdmcfg4(const CC1101Settings &s) { return chanbwIndex(s.rxBandwidthHz, 15) << 4 | drateE(s); }
+constexpr uint8_t mdmcfg2(const CC1101Settings &s) { return s.modulation << 4 | s.syncMode; }
+constexpr uint8_t mdmcfg1(const CC1101Settings &s) { return numPreamble(s.preambleBytes) << 4 | chanspcE(s); }
+constexpr uint8_t deviatn(const CC1101Settings &s) { return deviationE(s) << 4 | deviationM(s); }
+
+} // namespace cc1101_profile
+
+/* Registers without a setting of their own get the values of the reverse
+engineered RFT configuration, or their reset value. */
+constexpr CC1101Profile cc1101Profile(const CC1101Settings &s)
+{
+	using namespace cc1101_profile;
+	return CC1101Profile{{
+		s.iocfg2,						// IOCFG2
+		s.iocfg1,						// IOCFG1
+		s.iocfg0,						// IOCFG0
+		0x07,							// FIFOTHR
+		(uint8_t)(s.syncWord >> 8),		// SYNC1
+		(uint8_t)s.syncWord,			// SYNC0
+		s.packetLength,					// PKTLEN
+		s.pktctrl1,						// PKTCTRL1
+		s.pktctrl0,						// PKTCTRL0
+		0x00,							// ADDR
+		0x00,							// CHANNR
+		0x06,							// FSCTRL1: IF frequency 152kHz
+		0x00,							// FSCTRL0
+		(uint8_t)(freq(s) >> 16),		// FREQ2
+		(uint8_t)(freq(s) >> 8),		// FREQ1
+		(uint8_t)freq(s),				// FREQ0
+		mdmcfg4(s),						// MDMCFG4
+		drateM(s),						// MDMCFG3
+		mdmcfg2(s),						// MDMCFG2
+		mdmcfg1(s),						// MDMCFG1
+		chanspcM(s),					// MDMCFG0
+		deviatn(s),						// DEVIATN
+		0x07,							// MCSM2
+		s.mcsm1,						// MCSM1
+		s.mcsm0,						// MCSM0
+		0x16,							// FOCCFG
+		0x6C,							// BSCFG
+		0x43,							// AGCCTRL2
+		0x40,							// AGCCTRL1
+		0x91,							// AGCCTRL0
+		0x87,							// WOREVT1
+		0x6B,							// WOREVT0
+		0xF8,							// WORCTRL
+		0x56,							// FREND1
+		(uint8_t)(0x10 | s.paIndex),	// FREND0
+		0xE9,							// FSCAL3
+		0x2A,							// FSCAL2
+		0x00,							// FSCAL1
+		0x11,							// FSCAL0
+		0x41,							// RCCTRL1
+		0x00,							// RCCTRL0
+		0x59,							// FSTEST
+		0x7F,							// PTEST
+		0x3F,							// AGCTEST
+		0x81,							// TEST2
+		0x35,							// TEST1
+		0x09,							// TEST0
+	}};
+}
+
+#endif /* CC1101PROFILE_H_ */
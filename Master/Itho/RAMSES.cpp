@@ -15,8 +15,10 @@
   (byte & 0x01 ? '1' : '0')
 
 #include "RAMSES.h"
+#include "CC1101Profile.h"
 #include "bitbuffer.h"
 #include <string.h>
+#include <stdarg.h>
 #include <Arduino.h>
 #include <SPI.h>
 
@@ -40,105 +42,123 @@
 // #define SYNC0 42
 // #define MDMCFG2 0x02 //16bit sync word / 16bit specific
 
+/** Decoders should return n>0 for n packets successfully decoded,
+    an ABORT code if the bitbuffer is no applicable,
+    or a FAIL code if the message is malformed. */
+enum decode_return_codes {
+    DECODE_FAIL_OTHER   = 0, ///< legacy, do not use
+    /** Bitbuffer row count or row length is wrong for this sensor. */
+    DECODE_ABORT_LENGTH = -1,
+    DECODE_ABORT_EARLY  = -2,
+    /** Message Integrity Check failed: e.g. checksum/CRC doesn't validate. */
+    DECODE_FAIL_MIC     = -3,
+    DECODE_FAIL_SANITY  = -4,
+};
+
 // default constructor
-RAMSES::RAMSES(uint8_t counter, uint8_t sendTries) : CC1101()
+RAMSES *RAMSES::interruptInstance = NULL;
+
+RAMSES::RAMSES(uint8_t counter, uint8_t sendTries) : CC1101(),
+  calibrated(false), lastCalibration(0), fastTurnaround(true), turnaroundRxTx(0), turnaroundTxRx(0),
+  packetIrq(false), irqTicks(0), irqPin(-1), lastPoll(0), packetsReceived(0),
+  rxFrame(NULL), rxLength(0), rxResync(false), rxKept(false), framesBackToBack(0), recorder(NULL), ringHighWater(0),
+  numSubscribers(0), dedupWindow(RAMSES_DEDUP_WINDOW_MS), framesUnique(0), framesDuplicate(0),
+  txCacheNext(0), txCacheHits(0), txCacheMisses(0)
 {
+  memset(dedupCache, 0, sizeof(dedupCache));
+  for (uint8_t i = 0; i < RAMSES_TX_CACHE_SIZE; i++)
+    txCache[i] = RAMSESTxCacheEntry();    //value-initialized: zero, so no lookup can hit an indeterminate entry
+
   // this->outMessage.counter = counter;
-  // this->sendTries = sendTries;
+  this->sendTries = sendTries;
 
-  // this->outMessage.deviceId[0] = 33;
-  // this->outMessage.deviceId[1] = 66;
-  // this->outMessage.deviceId[2] = 99;
+  setDeviceID(33, 66, 99);
 
   // this->outMessage.deviceType = 22;
 
 } //RAMSES
 
-void RAMSES::initSendMessage(uint8_t len)
-{
-  //finishTransfer();
-  writeCommand(CC1101_SIDLE);
-  delayMicroseconds(1);
-  writeRegister(CC1101_IOCFG0 , 0x2E);
-  delayMicroseconds(1);
-  writeRegister(CC1101_IOCFG1 , 0x2E);
-  delayMicroseconds(1);
-  writeCommand(CC1101_SIDLE);
-  writeCommand(CC1101_SPWD);
-  delayMicroseconds(2);
-
-  /*
-    Configuration reverse engineered from remote print. The commands below are used by IthoDaalderop.
-    Base frequency      868.299866MHz
-    Channel             0
-    Channel spacing     199.951172kHz
-    Carrier frequency   868.299866MHz
-    Xtal frequency      26.000000MHz
-    Data rate           38.3835kBaud
-    Manchester          disabled
-    Modulation          2-FSK
-    Deviation           50.781250kHz
-    TX power            ?
-    PA ramping          enabled
-    Whitening           disabled
-  */
-  writeCommand(CC1101_SRES);
-  delayMicroseconds(1);
-  writeRegister(CC1101_IOCFG0 , 0x2E);    //High impedance (3-state)
-  writeRegister(CC1101_FREQ2 , 0x21);   //00100001  878MHz-927.8MHz
-  writeRegister(CC1101_FREQ1 , 0x65);   //01100101
-  writeRegister(CC1101_FREQ0 , 0x6A);   //01101010
-  writeRegister(CC1101_MDMCFG4 , 0x5A); //difference compared to message1
-  writeRegister(CC1101_MDMCFG3 , 0x83); //difference compared to message1
-  writeRegister(CC1101_MDMCFG2 , 0x00); //00000000  2-FSK, no manchester encoding/decoding, no preamble/sync
-  writeRegister(CC1101_MDMCFG1 , 0x22); //00100010
-  writeRegister(CC1101_MDMCFG0 , 0xF8); //11111000
-  writeRegister(CC1101_CHANNR , 0x00);    //00000000
-  writeRegister(CC1101_DEVIATN , 0x50); //difference compared to message1
-  writeRegister(CC1101_FREND0 , 0x17);    //00010111  use index 7 in PA table
-  writeRegister(CC1101_MCSM0 , 0x18);   //00011000  PO timeout Approx. 146microseconds - 171microseconds, Auto calibrate When going from IDLE to RX or TX (or FSTXON)
-  writeRegister(CC1101_FSCAL3 , 0xA9);    //10101001
-  writeRegister(CC1101_FSCAL2 , 0x2A);    //00101010
-  writeRegister(CC1101_FSCAL1 , 0x00);    //00000000
-  writeRegister(CC1101_FSCAL0 , 0x11);    //00010001
-  writeRegister(CC1101_FSTEST , 0x59);    //01011001  For test only. Do not write to this register.
-  writeRegister(CC1101_TEST2 , 0x81);   //10000001  For test only. Do not write to this register.
-  writeRegister(CC1101_TEST1 , 0x35);   //00110101  For test only. Do not write to this register.
-  writeRegister(CC1101_TEST0 , 0x0B);   //00001011  For test only. Do not write to this register.
-  writeRegister(CC1101_PKTCTRL0 , 0x12);  //00010010  Enable infinite length packets, CRC disabled, Turn data whitening off, Serial Synchronous mode
-  writeRegister(CC1101_ADDR , 0x00);    //00000000
-  writeRegister(CC1101_PKTLEN , 0xFF);    //11111111  //Not used, no hardware packet handling
+/*
+  Radio configuration, reverse engineered from RFT and remote prints.
+
+  Base frequency      868.299866MHz
+  Channel             0
+  Channel spacing     199.951172kHz
+  Carrier frequency   868.299866MHz
+  Xtal frequency      26.000000MHz
+  Data rate           38.3835kBaud
+  RX filter BW        325.000000kHz
+  Manchester          disabled
+  Modulation          2-FSK
+  Deviation           50.781250kHz
+  PA ramping          enabled
+  Whitening           disabled
+*/
+static constexpr CC1101Settings ramsesReceiveSettings = {
+  868300000,              // carrier
+  38400,                  // data rate
+  50781,                  // deviation
+  325000,                 // RX filter bandwidth
+  200000,                 // channel spacing
+  CC1101_MOD_2FSK,
+  MDMCFG2 & 0x07,         // sync mode
+  SYNC1 << 8 | SYNC0,
+  4,                      // preamble bytes
+  0xFF,                   // PKTLEN: set once the frame length is known (sync at beginning of message is removed by CC1101)
+  0x00,                   // PKTCTRL1: no address check, no status bytes appended
+  0x02,                   // PKTCTRL0: infinite packet length until the header is in, FIFO mode, CRC and whitening disabled
+  0x40,                   // IOCFG2: inverted RX FIFO threshold (FIFOTHR: 32 bytes, enough for the header); 0x06 once the length is known
+  0x2E,                   // IOCFG1: high impedance (3-state)
+  0x0D,                   // IOCFG0: serial data output
+  0x3C,                   // MCSM1: CCA when RSSI below threshold unless receiving, stay in RX after a packet
+  0x08,                   // MCSM0: no auto calibration, the cached calibration is written back instead
+  7,                      // PATABLE index
+};
 
-  //0x6F,0x26,0x2E,0x8C,0x87,0xCD,0xC7,0xC0
-  writeBurstRegister(CC1101_PATABLE | CC1101_WRITE_BURST, (uint8_t*)ithoPaTableSend, 8);
+//Itho is using serial mode for transmit. We use the TX FIFO with fixed packet length for simplicity,
+//and send preamble and sync word as part of the packet.
+static constexpr CC1101Settings ramsesSendSettings = {
+  868300000,
+  38400,
+  50781,
+  325000,
+  200000,
+  CC1101_MOD_2FSK,
+  CC1101_SYNC_NONE,
+  SYNC1 << 8 | SYNC0,
+  4,
+  0xFF,                   // PKTLEN: set per message
+  0x00,
+  0x00,
+  0x06,
+  0x2E,
+  0x2E,                   // IOCFG0: high impedance (3-state)
+  0x30,                   // MCSM1: IDLE after TX
+  0x08,
+  7,
+};
 
-  //difference, message1 sends a STX here
-  writeCommand(CC1101_SIDLE);
-  writeCommand(CC1101_SIDLE);
+static constexpr CC1101Profile ramsesReceiveProfile = cc1101Profile(ramsesReceiveSettings);
+static constexpr CC1101Profile ramsesSendProfile = cc1101Profile(ramsesSendSettings);
 
-  writeRegister(CC1101_MDMCFG4 , 0x5A); //difference compared to message1
-  writeRegister(CC1101_MDMCFG3 , 0x83); //difference compared to message1
-  writeRegister(CC1101_DEVIATN , 0x50); //difference compared to message1
-  writeRegister(CC1101_IOCFG0 , 0x2D);    //GDO0_Z_EN_N. When this output is 0, GDO0 is configured as input (for serial TX data).
-  writeRegister(CC1101_IOCFG1 , 0x0B);    //Serial Clock. Synchronous to the data in synchronous serial mode.
+static_assert(ramsesReceiveProfile.regs[CC1101_FREQ2] == 0x21 && ramsesReceiveProfile.regs[CC1101_FREQ1] == 0x65
+              && ramsesReceiveProfile.regs[CC1101_FREQ0] == 0x6A, "carrier is not 868.3MHz");
+static_assert(ramsesReceiveProfile.regs[CC1101_MDMCFG4] == 0x5A && ramsesReceiveProfile.regs[CC1101_MDMCFG3] == 0x83,
+              "data rate or RX bandwidth differs from the RFT");
+static_assert(ramsesReceiveProfile.regs[CC1101_MDMCFG1] == 0x22 && ramsesReceiveProfile.regs[CC1101_MDMCFG0] == 0xF8,
+              "preamble or channel spacing differs from the RFT");
+static_assert(ramsesReceiveProfile.regs[CC1101_DEVIATN] == 0x50, "deviation differs from the RFT");
+static_assert(ramsesReceiveProfile.regs[CC1101_FREND0] == 0x17, "PA index differs from the RFT");
+static_assert(ramsesSendProfile.regs[CC1101_MDMCFG2] == 0x00, "transmit sends its own preamble and sync word");
 
-  writeCommand(CC1101_STX);
+void RAMSES::initSendMessage(uint8_t len)
+{
   writeCommand(CC1101_SIDLE);
+  writeCommand(CC1101_SRES);
 
-  writeRegister(CC1101_MDMCFG4 , 0x5A); //difference compared to message1
-  writeRegister(CC1101_MDMCFG3 , 0x83); //difference compared to message1
-  writeRegister(CC1101_DEVIATN , 0x50); //difference compared to message1
-  //writeRegister(CC1101_IOCFG0 ,0x2D);   //GDO0_Z_EN_N. When this output is 0, GDO0 is configured as input (for serial TX data).
-  //writeRegister(CC1101_IOCFG1 ,0x0B);   //Serial Clock. Synchronous to the data in synchronous serial mode.
-
-  //Itho is using serial mode for transmit. We want to use the TX FIFO with fixed packet length for simplicity.
-  writeRegister(CC1101_IOCFG0 , 0x2E);
-  writeRegister(CC1101_IOCFG1 , 0x2E);
-  writeRegister(CC1101_PKTCTRL0 , 0x00);
-  writeRegister(CC1101_PKTCTRL1 , 0x00);
-
-  writeRegister(CC1101_PKTLEN , len);
-
+  loadRadioProfile(ramsesSendProfile, len);
+  //0x6F,0x26,0x2E,0x8C,0x87,0xCD,0xC7,0xC0
+  writeBurstRegister(CC1101_PATABLE, ithoPaTableSend, 8);
 }
 
 void RAMSES::finishTransfer()
@@ -155,146 +175,567 @@ void RAMSES::finishTransfer()
 
 void RAMSES::initReceive()
 {
-  /*
-    Configuration reverse engineered from RFT print.
-
-    Base frequency      868.299866MHz
-    Channel             0
-    Channel spacing     199.951172kHz
-    Carrier frequency   868.299866MHz
-    Xtal frequency      26.000000MHz
-    Data rate           38.3835kBaud
-    RX filter BW        325.000000kHz
-    Manchester          disabled
-    Modulation          2-FSK
-    Deviation           50.781250kHz
-    TX power            0x6F,0x26,0x2E,0x7F,0x8A,0x84,0xCA,0xC4
-    PA ramping          enabled
-    Whitening           disabled
-  */
   writeCommand(CC1101_SRES);
+  calibrated = false;
+  rxFrame = NULL;
+  rxLength = 0;
+  rxKept = false;
 
-  writeRegister(CC1101_TEST0 , 0x09);
-  writeRegister(CC1101_FSCAL2 , 0x00);
-
+  loadRadioProfile(ramsesReceiveProfile, ramsesReceiveSettings.packetLength);
   //0x6F,0x26,0x2E,0x7F,0x8A,0x84,0xCA,0xC4
-  writeBurstRegister(CC1101_PATABLE | CC1101_WRITE_BURST, (uint8_t*)ithoPaTableReceive, 8);
+  writeBurstRegister(CC1101_PATABLE, ithoPaTableReceive, 8);
 
-  writeCommand(CC1101_SCAL);
+  calibrate();
+  enterReceive();
+}
 
-  //wait for calibration to finish
-  while ((readRegisterWithSyncProblem(CC1101_MARCSTATE, CC1101_STATUS_REGISTER)) != CC1101_MARCSTATE_IDLE) yield();
-
-  writeRegister(CC1101_FSCAL2 , 0x00);
-  writeRegister(CC1101_MCSM0 , 0x18);     //no auto calibrate
-  writeRegister(CC1101_FREQ2 , 0x21);
-  writeRegister(CC1101_FREQ1 , 0x65);
-  writeRegister(CC1101_FREQ0 , 0x6A);
-  writeRegister(CC1101_IOCFG0 , 0x2E);      //High impedance (3-state)
-  writeRegister(CC1101_IOCFG2 , 0x06);      //0x06 Assert when sync word has been sent / received, and de-asserts at the end of the packet.
-  writeRegister(CC1101_FSCTRL1 , 0x06);
-  writeRegister(CC1101_FSCTRL0 , 0x00);
-  writeRegister(CC1101_MDMCFG4 , 0x5A);
-  writeRegister(CC1101_MDMCFG3 , 0x83);
-  writeRegister(CC1101_MDMCFG2 , 0x00);   //Enable digital DC blocking filter before demodulator, 2-FSK, Disable Manchester encoding/decoding, No preamble/sync
-  writeRegister(CC1101_MDMCFG1 , 0x22);   //Disable FEC
-  writeRegister(CC1101_MDMCFG0 , 0xF8);
-  writeRegister(CC1101_CHANNR , 0x00);
-  writeRegister(CC1101_DEVIATN , 0x50);
-  writeRegister(CC1101_FREND1 , 0x56);
-  writeRegister(CC1101_FREND0 , 0x17);
-  writeRegister(CC1101_MCSM0 , 0x18);     //no auto calibrate
-  writeRegister(CC1101_FOCCFG , 0x16);
-  writeRegister(CC1101_BSCFG , 0x6C);
-  writeRegister(CC1101_AGCCTRL2 , 0x43);
-  writeRegister(CC1101_AGCCTRL1 , 0x40);
-  writeRegister(CC1101_AGCCTRL0 , 0x91);
-  writeRegister(CC1101_FSCAL3 , 0xE9);
-  writeRegister(CC1101_FSCAL2 , 0x2A);
-  writeRegister(CC1101_FSCAL1 , 0x00);
-  writeRegister(CC1101_FSCAL0 , 0x11);
-  writeRegister(CC1101_FSTEST , 0x59);
-  writeRegister(CC1101_TEST2 , 0x81);
-  writeRegister(CC1101_TEST1 , 0x35);
-  writeRegister(CC1101_TEST0 , 0x0B);
-  writeRegister(CC1101_PKTCTRL1 , 0x04);    //No address check, Append two bytes with status RSSI/LQI/CRC OK,
-  writeRegister(CC1101_PKTCTRL0 , 0x32);    //Infinite packet length mode, CRC disabled for TX and RX, No data whitening, Asynchronous serial mode, Data in on GDO0 and data out on either of the GDOx pins
-  writeRegister(CC1101_ADDR , 0x00);
-  writeRegister(CC1101_PKTLEN , 0xFF);
-  writeRegister(CC1101_TEST0 , 0x09);
+void RAMSES::initReceiveMessage()
+{
+  writeCommand(CC1101_SIDLE); //idle
+  loadRadioProfile(ramsesReceiveProfile, ramsesReceiveSettings.packetLength);
+  enterReceive();
+}
 
+void RAMSES::calibrate()
+{
   writeCommand(CC1101_SCAL);
 
   //wait for calibration to finish
-  while ((readRegisterWithSyncProblem(CC1101_MARCSTATE, CC1101_STATUS_REGISTER)) != CC1101_MARCSTATE_IDLE) yield();
-
-  writeRegister(CC1101_MCSM0 , 0x18);     //no auto calibrate
+  while (state() != CC1101_STATE_IDLE) yield();
 
-  writeCommand(CC1101_SIDLE);
-  writeCommand(CC1101_SIDLE);
-
-  writeRegister(CC1101_MDMCFG2 , 0x00);   //Enable digital DC blocking filter before demodulator, 2-FSK, Disable Manchester encoding/decoding, No preamble/sync
-  writeRegister(CC1101_IOCFG0 , 0x0D);      //Serial Data Output. Used for asynchronous serial mode.
-
-  writeCommand(CC1101_SRX);
-
-  while ((readRegisterWithSyncProblem(CC1101_MARCSTATE, CC1101_STATUS_REGISTER)) != CC1101_MARCSTATE_RX) yield();
-
-  initReceiveMessage();
+  readBurstRegister(fscal, CC1101_FSCAL3, 3);
+  calibrated = true;
+  lastCalibration = millis();
 }
 
-void  RAMSES::initReceiveMessage()
+//load a profile, with the packet length and (once known) the cached calibration filled in
+void RAMSES::loadRadioProfile(const CC1101Profile &profile, uint8_t length)
 {
-  uint8_t marcState;
+  CC1101Profile regs = profile;
 
-  writeCommand(CC1101_SIDLE); //idle
+  regs.regs[CC1101_PKTLEN] = length;
+  if (calibrated)
+    memcpy(&regs.regs[CC1101_FSCAL3], fscal, sizeof(fscal));
+  loadProfile(regs);
+}
 
-  //set datarate
-  writeRegister(CC1101_MDMCFG4 , 0x5A); // set kBaud
-  writeRegister(CC1101_MDMCFG3 , 0x83); // set kBaud
-  writeRegister(CC1101_DEVIATN , 0x50);
+//only write the registers in which two profiles differ (and the packet length); the calibration stays
+void RAMSES::switchRadioProfile(const CC1101Profile &from, const CC1101Profile &to, uint8_t length)
+{
+  for (uint8_t i = 0; i < CC1101_CONFIG_REGISTERS; i++) {
+    if (i == CC1101_PKTLEN)
+      writeRegister(i, length);
+    else if (i < CC1101_FSCAL3 || i > CC1101_FSCAL1)
+      if (from.regs[i] != to.regs[i])
+        writeRegister(i, to.regs[i]);
+  }
+}
 
-  //set fifo mode with fixed packet length and sync bytes
-  writeRegister(CC1101_PKTLEN , 63);      //63 bytes message (sync at beginning of message is removed by CC1101)
+void RAMSES::sendPacket(CC1101Packet *packet)
+{
+  unsigned long start = micros();
+
+  // a frame coming in now is lost
+  rxFrame = NULL;
+  rxLength = 0;
+  rxKept = false;
+
+  if (fastTurnaround) {
+    // chip stays configured and calibrated, only the differences go over SPI
+    beginBatch();
+    writeCommand(CC1101_SIDLE);
+    switchRadioProfile(ramsesReceiveProfile, ramsesSendProfile, packet->length);
+    writeBurstRegister(CC1101_PATABLE, ithoPaTableSend, 8);
+    endBatch();
+  }
+  else {
+    initSendMessage(packet->length);
+  }
+  unsigned long ready = micros();
+  turnaroundRxTx = ready - start;
+
+  sendData(packet);
+
+  start = micros();
+  if (fastTurnaround) {
+    beginBatch();
+    writeCommand(CC1101_SIDLE);
+    switchRadioProfile(ramsesSendProfile, ramsesReceiveProfile, ramsesReceiveSettings.packetLength);
+    writeCommand(CC1101_SFRX);
+    endBatch();
+    enterReceive();
+  }
+  else {
+    finishTransfer();
+    initReceive();
+  }
+  turnaroundTxRx = micros() - start;
+}
 
-  //set fifo mode with fixed packet length and sync bytes
-  writeRegister(CC1101_PKTCTRL0 , 0x00);
-  writeRegister(CC1101_SYNC1 , SYNC1);
-  writeRegister(CC1101_SYNC0 , SYNC0);
-  writeRegister(CC1101_MDMCFG2 , MDMCFG2);
-  writeRegister(CC1101_PKTCTRL1 , 0x00);
+void RAMSES::enterReceive()
+{
+  uint8_t chipState;
 
   writeCommand(CC1101_SRX); //switch to RX state
 
   // Check that the RX state has been entered
-  while (((marcState = readRegisterWithSyncProblem(CC1101_MARCSTATE, CC1101_STATUS_REGISTER)) & CC1101_BITS_MARCSTATE) != CC1101_MARCSTATE_RX)
+  while ((chipState = state()) != CC1101_STATE_RX)
   {
-    if (marcState == CC1101_MARCSTATE_RXFIFO_OVERFLOW) // RX_OVERFLOW
+    if (chipState == CC1101_STATE_RX_OVERFLOW) // RX_OVERFLOW
       writeCommand(CC1101_SFRX); //flush RX buffer
   }
 }
 
+ICACHE_RAM_ATTR void RAMSES::packetInterrupt() {
+  if (interruptInstance) {
+    interruptInstance->irqTicks.store(RAMSES_PROBE_SHARED(), std::memory_order_relaxed);
+    interruptInstance->packetIrq.store(true);
+  }
+}
+
+void RAMSES::enableInterrupt(uint8_t pin) {
+  // GDO2 falls when the RX FIFO fills up to the threshold (IOCFG2 = 0x40),
+  // enough to tell the frame length; then with IOCFG2 = 0x06 at the end of
+  // the packet (or on RX FIFO overflow). Either way the falling edge means
+  // there is something in the FIFO to deal with.
+  interruptInstance = this;
+  irqPin = pin;
+  lastPoll = millis();
+  packetIrq.store(false);
+  pinMode(pin, INPUT);
+  attachInterrupt(digitalPinToInterrupt(pin), packetInterrupt, FALLING);
+}
+
+void RAMSES::disableInterrupt() {
+  if (irqPin < 0)
+    return;
+  detachInterrupt(digitalPinToInterrupt(irqPin));
+  irqPin = -1;
+  interruptInstance = NULL;
+}
+
+bool RAMSES::waitForPacket(unsigned long timeout) {
+  unsigned long start = millis();
+  while (!packetIrq.load()) {
+    if (millis() - start >= timeout)
+      return false;
+    yield();
+  }
+  return true;
+}
+
+//records the time from begin() until it goes out of scope, whichever way that is
+struct StageTimer {
+  RAMSESHistogram *histogram;
+  uint32_t start;
+  StageTimer() : histogram(NULL), start(0) {}
+  ~StageTimer() { if (histogram) RAMSES_PROBE_END(*histogram, start); }
+  void begin(RAMSESHistogram *h) { histogram = h; start = RAMSES_PROBE(); }
+};
+
 bool RAMSES::checkForNewPacket() {
-  CC1101Packet inPacket;
-  RAMSESMessage inMessage;
+  receivePacket();
+  return processPacket();
+}
+
+bool RAMSES::receivePacket() {
+  stats.tick(millis());
 
-  if (receiveData(&inPacket, 63) && messageDecode(&inPacket, &inMessage) > 0) {
-    int err = messageParse(&inMessage);
-    if (err <= 0) {
-      Serial.printf("Parse error: %d\n", err);
+  // may cost the packet that is on the air right now, once every few minutes
+  if (!rxFrame && calibrated && millis() - lastCalibration >= RAMSES_RECALIBRATE_MS) {
+    writeCommand(CC1101_SIDLE);
+    calibrate();
+    writeCommand(CC1101_SFRX);
+    enterReceive();
+  }
+
+  if (irqPin >= 0) {
+    bool irq = packetIrq.exchange(false);
+    if (!irq && millis() - lastPoll < RAMSES_IRQ_FALLBACK_MS)
       return false;
-    }
+    if (irq)
+      RAMSES_PROBE_SHARED_END(latency[RAMSES_STAGE_IRQ], irqTicks.load(std::memory_order_relaxed));
+    lastPoll = millis();
+  }
+
+  StageTimer receiveTimer;
+  uint8_t status = readStatus(true);
+  uint8_t rxBytes = status & CC1101_STATUS_FIFO_BYTES_AVAILABLE_BM;
 
-    err = messageInterpret(&inMessage);
-    if (err <= 0) {
-      Serial.printf("Interpret error: %d\n", err);
+  if ((status & CC1101_STATUS_STATE_BM) == CC1101_STATE_RX_OVERFLOW) {
+    RAMSES_LOG(logRing, RAMSES_LOG_WARN, RAMSES_LOG_FIFO_OVERFLOW, rxFrame ? rxFrame->packet.length : 0, 0, 0);
+    stats.add(RAMSES_STAT_FIFO_OVERFLOW);
+    recordFrame(RAMSES_STAT_FIFO_OVERFLOW);
+    restartReceive();
+    return false;
+  }
+
+  // take the FIFO in chunks: at least 15 bytes (where the status byte
+  // saturates), or whatever completes a frame of known length
+  uint8_t remaining = rxFrame && rxLength ? rxLength - rxFrame->packet.length : 0;
+  if (rxBytes == 0 || (rxBytes < CC1101_STATUS_FIFO_BYTES_AVAILABLE_BM && rxBytes < remaining)
+      || (rxBytes < CC1101_STATUS_FIFO_BYTES_AVAILABLE_BM && !remaining))
+    return false;
+  receiveTimer.begin(&latency[RAMSES_STAGE_RECEIVE]);
+  if (rxBytes == CC1101_STATUS_FIFO_BYTES_AVAILABLE_BM)
+    rxBytes = readRegisterWithSyncProblem(CC1101_RXBYTES, CC1101_STATUS_REGISTER) & CC1101_BITS_RX_BYTES_IN_FIFO;
+
+  if (!rxFrame) {
+    // read straight into the next ring slot; when the decoder is behind, the
+    // FIFO still has to be drained, so read into a scratch frame and drop it
+    rxFrame = rxRing.claim();
+    if (!rxFrame)
+      rxFrame = &rxScratch;
+    rxFrame->packet.length = 0;
+    rxLength = 0;
+    rxDecoder.reset();
+  }
+
+  // never empty the FIFO while the packet is coming in (CC1101 errata): the
+  // last byte is only taken once it ends the frame
+  CC1101Packet *packet = &rxFrame->packet;
+  uint8_t count = rxLength && rxBytes >= remaining ? remaining : rxBytes - 1;
+  if (packet->length + count > sizeof(packet->data)) {
+    stats.add(RAMSES_STAT_LENGTH);
+    recordFrame(RAMSES_STAT_LENGTH);
+    restartReceive();
+    return false;
+  }
+  uint32_t start = RAMSES_PROBE();
+  readBurstRegister(&packet->data[packet->length], CC1101_RXFIFO, count);
+  RAMSES_PROBE_END(latency[RAMSES_STAGE_FIFO_READ], start);
+  stats.add(RAMSES_STAT_BYTES, count);
+
+  // decode as it comes in, so noise is dropped and RX re-armed right away
+  start = RAMSES_PROBE();
+  int decoded = rxDecoder.feed(&packet->data[packet->length], count);
+  RAMSES_PROBE_END(latency[RAMSES_STAGE_STREAM_DECODE], start);
+  packet->length += count;
+  if (decoded < 0 || rxDecoder.frameLength() > sizeof(packet->data)) {
+    uint8_t reason = decoded < 0 ? rxDecoder.rejectReason() : (uint8_t)RAMSES_STAT_LENGTH;
+    RAMSES_LOG_DATA(logRing, RAMSES_LOG_DEBUG, RAMSES_LOG_STREAM_REJECT, decoded, packet->length, reason, packet->data, packet->length);
+    stats.add(reason);
+    recordFrame(reason);
+    restartReceive();
+    return false;
+  }
+
+  bool learned = false;
+  if (!rxLength) {
+    if (!rxDecoder.frameLength())
       return false;
+    rxLength = rxDecoder.frameLength();
+    learned = true;
+
+    // when the chip is already past the end, the next frame has no boundary: flush after this one
+    rxResync = packet->length + rxBytes - count >= rxLength;
+
+    // signal strength while the carrier is still there; LQI is latched 64
+    // symbols after the sync word, long before this, so one read is enough
+    rxFrame->rssi = readRegisterWithSyncProblem(CC1101_RSSI, CC1101_STATUS_REGISTER);
+    rxFrame->lqi = readRegister(CC1101_LQI | CC1101_STATUS_REGISTER) & 0x7F;
+  }
+
+  if (packet->length < rxLength) {
+    // let the chip end the packet; GDO2 falls at its end once the rest fits
+    // in the FIFO, until then whenever the FIFO reaches the threshold
+    const uint8_t fits = CC1101_BUFFER_LEN - 4;
+    uint8_t left = rxLength - packet->length;
+
+    beginBatch();
+    if (learned && !rxResync) {
+      writeRegister(CC1101_PKTLEN, rxLength);
+      writeRegister(CC1101_PKTCTRL0, ramsesReceiveSettings.pktctrl0 & ~0x03);
     }
+    if (left <= fits && (learned || remaining > fits))
+      writeRegister(CC1101_IOCFG2, 0x06);
+    endBatch();
+  }
+  if (packet->length < rxLength)
+    return false;
+
+  // all of it read, so the trailer should have been there
+  if (decoded <= 0) {
+    RAMSES_LOG_DATA(logRing, RAMSES_LOG_DEBUG, RAMSES_LOG_STREAM_REJECT, decoded, packet->length, RAMSES_STAT_TRAILER, packet->data, packet->length);
+    stats.add(RAMSES_STAT_TRAILER);
+    recordFrame(RAMSES_STAT_TRAILER);
+    restartReceive();
+    return false;
+  }
 
-    // initReceiveMessage(); // TODO: this shouldn't be needed?
-    return true;
+  RAMSESRawFrame *frame = rxFrame;
+  packet->length = rxLength;
+  frame->messageLength = rxDecoder.messageLength();
+  memcpy(frame->message, rxDecoder.message(), frame->messageLength);
+  bool ringFull = frame == &rxScratch;
+  recordFrame(ringFull ? RAMSES_STAT_RING_FULL : RAMSES_STATS);
+
+  // the chip went back to RX by itself (MCSM1), whatever is left in the FIFO is the next frame
+  bool backToBack = rxKept;
+  if (rxResync) {
+    restartReceive();
   }
-  return false;
+  else {
+    rxKept = rxBytes > count;
+    continueReceive();
+  }
+  packetsReceived++;
+  if (backToBack)
+    framesBackToBack++;
+
+  if (ringFull) {
+    stats.add(RAMSES_STAT_RING_FULL);
+    RAMSES_LOG(logRing, RAMSES_LOG_INFO, RAMSES_LOG_RING_FULL, stats.get(RAMSES_STAT_RING_FULL), 0, 0);
+    return false;
+  }
+  frame->timestamp = micros();
+  frame->ticks = RAMSES_PROBE_SHARED();
+  rxRing.publish();
+
+  uint16_t queued = rxRing.size();
+  if (queued > ringHighWater.load(std::memory_order_relaxed))
+    ringHighWater.store(queued, std::memory_order_relaxed);
+  return true;
+}
+
+bool RAMSES::setRecorder(RAMSESRecorder *recorder) {
+  this->recorder = recorder;
+  return !recorder || recorder->begin(ramsesReceiveProfile.regs);
+}
+
+void RAMSES::recordFrame(uint8_t stat) {
+  if (!recorder || !rxFrame)
+    return;
+  if (!rxLength) {
+    rxFrame->rssi = readRegisterWithSyncProblem(CC1101_RSSI, CC1101_STATUS_REGISTER);
+    rxFrame->lqi = readRegister(CC1101_LQI | CC1101_STATUS_REGISTER) & 0x7F;
+  }
+  // latched per packet like LQI
+  uint8_t freqest = readRegister(CC1101_FREQEST | CC1101_STATUS_REGISTER);
+  recorder->record(&rxFrame->packet, micros(), rxFrame->rssi, rxFrame->lqi, freqest, stat);
+}
+
+//drop what is in the FIFO and wait for the next sync word, in infinite packet length mode
+void RAMSES::restartReceive() {
+  rxFrame = NULL;
+  rxLength = 0;
+  rxKept = false;
+
+  beginBatch();
+  writeCommand(CC1101_SIDLE);
+  writeCommand(CC1101_SFRX);
+  writeRegister(CC1101_PKTCTRL0, ramsesReceiveSettings.pktctrl0);
+  writeRegister(CC1101_IOCFG2, ramsesReceiveSettings.iocfg2);
+  writeCommand(CC1101_SRX);
+  endBatch();
+}
+
+//after a frame, still in RX: back to infinite packet length for the next one, keeping what is in the FIFO
+void RAMSES::continueReceive() {
+  rxFrame = NULL;
+  rxLength = 0;
+
+  beginBatch();
+  writeRegister(CC1101_PKTCTRL0, ramsesReceiveSettings.pktctrl0);
+  writeRegister(CC1101_IOCFG2, ramsesReceiveSettings.iocfg2);
+  endBatch();
+}
+
+bool RAMSES::processPacket() {
+  RAMSESRawFrame *frame = rxRing.peek();
+  if (!frame)
+    return false;
+  RAMSES_PROBE_SHARED_END(latency[RAMSES_STAGE_QUEUE], frame->ticks);
+  uint32_t frameTicks = frame->ticks;
+
+  // parsed straight into the snapshot slot readers cannot see, published once accepted
+  RAMSESLastMessage *last = lastMessage.write();
+  RAMSESMessage *inMessage = &last->message;
+
+  // checked and Manchester decoded while it was received, only the fields are left
+  uint32_t start = RAMSES_PROBE();
+  int err = messageParse(frame->message, frame->messageLength, inMessage);
+  RAMSES_PROBE_END(latency[RAMSES_STAGE_PARSE], start);
+  uint32_t timestamp = frame->timestamp;
+  uint8_t rssi = frame->rssi, lqi = frame->lqi;
+  uint32_t hash = frameHash(frame->message, frame->messageLength);
+  rxRing.release();
+  if (err <= 0) {
+    RAMSES_LOG(logRing, err == DECODE_FAIL_MIC ? RAMSES_LOG_WARN : RAMSES_LOG_DEBUG, RAMSES_LOG_PARSE_ERROR, err, 0, 0);
+    stats.add(err == DECODE_ABORT_LENGTH ? RAMSES_STAT_LENGTH : err == DECODE_FAIL_MIC ? RAMSES_STAT_MIC : RAMSES_STAT_SANITY);
+    return false;
+  }
+  stats.add(RAMSES_STAT_PARSED);
+
+  // every copy counts for the device, retransmissions included
+  RAMSESDevice *device = trackDevice(inMessage, rssi, lqi);
+
+  // a retransmission of a frame seen within the window is not a new event
+  if (isDuplicate(hash, timestamp))
+    return false;
+
+  start = RAMSES_PROBE();
+  err = messageInterpret(inMessage, timestamp, rssi);
+  RAMSES_PROBE_END(latency[RAMSES_STAGE_INTERPRET], start);
+  if (err <= 0) {
+    RAMSES_LOG(logRing, RAMSES_LOG_WARN, RAMSES_LOG_INTERPRET_ERROR, err, inMessage->command,
+               inMessage->num_device_ids ? RAMSESDevices::packId(inMessage->device_id[0]) : 0);
+    if (device)
+      device->errors++;
+    return false;
+  }
+
+  RAMSES_PROBE_SHARED_END(latency[RAMSES_STAGE_FRAME_TO_EVENT], frameTicks);
+
+  last->command = messageCommand(inMessage);
+  last->timestamp = timestamp;
+  last->rssi = rssi;
+  lastMessage.publish();
+
+  // initReceiveMessage(); // TODO: this shouldn't be needed?
+  return true;
+}
+
+void RAMSES::resetLatency() {
+  for (uint8_t i = 0; i < RAMSES_STAGES; i++)
+    latency[i].reset();
+}
+
+void RAMSES::printLatency() {
+  static const char *const names[RAMSES_STAGES] = {
+    "irq", "fifo read", "stream decode", "receive", "queue", "parse", "interpret", "frame to event"
+  };
+  float perUs = ramsesTicksPerUs();
+
+  Serial.printf("%-15s %8s %10s %10s %10s %10s (us)\n", "stage", "count", "min", "p50", "p99", "max");
+  for (uint8_t i = 0; i < RAMSES_STAGES; i++) {
+    RAMSESLatencySummary s = latency[i].summary();
+    Serial.printf("%-15s %8lu %10.1f %10.1f %10.1f %10.1f\n", names[i], (unsigned long)s.count,
+                  s.min / perUs, s.p50 / perUs, s.p99 / perUs, s.max / perUs);
+  }
+}
+
+void RAMSES::printStats() {
+  uint32_t now = millis();
+
+  Serial.printf("%-15s %10s %10s %10s (/min)\n", "counter", "total", "1 min", "15 min");
+  for (uint8_t i = 0; i < RAMSES_STATS; i++) {
+    Serial.printf("%-15s %10lu %10.1f %10.1f\n", RAMSESStats::name(i), (unsigned long)stats.get(i),
+                  stats.rate(i, 1, now), stats.rate(i, 15, now));
+  }
+  Serial.printf("%-15s %10lu\n", "rejected", (unsigned long)stats.getRejected());
+}
+
+#if RAMSES_LOG_LEVEL > RAMSES_LOG_NONE
+unsigned RAMSES::printLog(unsigned max) {
+  RAMSESLogRecord record;
+  char line[128];
+  unsigned n = 0;
+  while (n < max && logRing.read(&record)) {
+    ramsesLogFormat(&record, line, sizeof(line));
+    Serial.println(line);
+    n++;
+  }
+  return n;
+}
+#endif
+
+bool RAMSES::getLastMessage(RAMSESMessage *msg) const {
+  uint32_t token;
+  do {
+    const RAMSESLastMessage *last = lastMessage.read(&token);
+    if (!last)
+      return false;
+    *msg = last->message;
+  } while (!lastMessage.valid(token));
+  return true;
+}
+
+IthoCommand RAMSES::getLastCommand() const {
+  uint32_t token;
+  IthoCommand command;
+  do {
+    const RAMSESLastMessage *last = lastMessage.read(&token);
+    if (!last)
+      return IthoUnknown;
+    command = last->command;
+  } while (!lastMessage.valid(token));
+  return command;
+}
+
+uint32_t RAMSES::getLastID() const {
+  uint32_t token, id;
+  do {
+    const RAMSESLastMessage *last = lastMessage.read(&token);
+    if (!last)
+      return RAMSES_DEVICE_NONE;
+    id = last->message.num_device_ids ? RAMSESDevices::packId(last->message.device_id[0]) : RAMSES_DEVICE_NONE;
+  } while (!lastMessage.valid(token));
+  return id;
+}
+
+//snprintf() at offset n of buf, returning the total length snprintf() would
+static int appendf(char *buf, size_t size, int n, const char *format, ...) {
+  va_list args;
+  size_t at = (size_t)n < size ? n : size;
+  va_start(args, format);
+  int r = vsnprintf(buf + at, size - at, format, args);
+  va_end(args);
+  return n + (r > 0 ? r : 0);
+}
+
+//e.g. "22F1 29:157157 -> 50:072496 000204 (low)"
+int RAMSES::LastMessageDecoded(char *buf, size_t size) const {
+  static const char *const commandNames[] = {
+    "unknown", "join", "leave", "standby", "low", "medium", "high", "full", "timer1", "timer2", "timer3"
+  };
+  RAMSESLastMessage last;
+  if (!lastMessage.copy(&last))
+    return appendf(buf, size, 0, "%s", "");
+
+  const RAMSESMessage *msg = &last.message;
+  int n = appendf(buf, size, 0, "%04X", msg->command);
+  for (unsigned i = 0; i < msg->num_device_ids; i++) {
+    uint32_t id = RAMSESDevices::packId(msg->device_id[i]);
+    n = appendf(buf, size, n, "%s%02u:%06u", i ? " -> " : " ", (unsigned)(id >> 18), (unsigned)(id & 0x3FFFF));
+  }
+  n = appendf(buf, size, n, " ");
+  for (unsigned i = 0; i < msg->payload_length; i++)
+    n = appendf(buf, size, n, "%02X", msg->payload()[i]);
+  if (last.command != IthoUnknown)
+    n = appendf(buf, size, n, " (%s)", commandNames[last.command]);
+  return n;
+}
+
+//the remote command a message carries, by the send tables: opcode, payload length and first payload bytes
+IthoCommand RAMSES::messageCommand(const RAMSESMessage *msg) {
+  for (int c = IthoJoin; c <= IthoTimer3; c++) {
+    if (c == IthoStandby)   //no table yet
+      continue;
+    const uint8_t *bytes = getMessageCommandBytes((IthoCommand)c);
+    if (msg->command == (bytes[0] << 8 | bytes[1]) && msg->payload_length == bytes[2]
+        && msg->payload_length >= 3 && memcmp(msg->payload(), &bytes[3], 3) == 0)
+      return (IthoCommand)c;
+  }
+  return IthoUnknown;
+}
+
+RAMSESDevice *RAMSES::trackDevice(const RAMSESMessage *msg, uint8_t rssi, uint8_t lqi) {
+  if (!msg->num_device_ids)
+    return NULL;
+
+  RAMSESDevice *device = devices.update(RAMSESDevices::packId(msg->device_id[0]));
+  if (!device)
+    return NULL;
+
+  device->lastSeen = millis();
+  device->frames++;
+  device->rssi = rssi;
+  device->lqi = lqi;
+  // 22F1 fan mode: payload 00 <mode> <modes>
+  if (msg->command == 0x22F1 && msg->payload_length >= 2)
+    device->fanSetting = msg->payload()[1];
+  return device;
 }
 
 int add_bytes(uint8_t const message[], unsigned num_bytes)
@@ -306,19 +747,6 @@ int add_bytes(uint8_t const message[], unsigned num_bytes)
     return result;
 }
 
-/** Decoders should return n>0 for n packets successfully decoded,
-    an ABORT code if the bitbuffer is no applicable,
-    or a FAIL code if the message is malformed. */
-enum decode_return_codes {
-    DECODE_FAIL_OTHER   = 0, ///< legacy, do not use
-    /** Bitbuffer row count or row length is wrong for this sensor. */
-    DECODE_ABORT_LENGTH = -1,
-    DECODE_ABORT_EARLY  = -2,
-    /** Message Integrity Check failed: e.g. checksum/CRC doesn't validate. */
-    DECODE_FAIL_MIC     = -3,
-    DECODE_FAIL_SANITY  = -4,
-};
-
 static uint8_t next(const uint8_t *bb, unsigned *ipos, unsigned num_bytes)
 {
     uint8_t r = bitrow_get_byte(bb, *ipos);
@@ -328,15 +756,25 @@ static uint8_t next(const uint8_t *bb, unsigned *ipos, unsigned num_bytes)
     return r;
 }
 
-int RAMSES::messageParse(RAMSESMessage *msg) {
-  // TODO: only populate Message here; shouldn't contain the bits
-  bitbuffer_t *bmsg = &msg->bits;
+static uint8_t header_num_device_ids(uint8_t header)
+{
+  return header == 0x14 ? 1 :
+         header == 0x18 ? 2 :
+         header == 0x1c ? 2 :
+         header == 0x10 ? 2 :
+         header == 0x3c ? 2 :
+         (header >> 2) & 0x03; // total speculation.
+}
+
+int RAMSES::messageParseReference(const bitbuffer_t *bmsg, RAMSESMessage *msg) {
   const int row = 0;
 
   if (!bmsg || row >= bmsg->num_rows || bmsg->bits_per_row[row] < 8)
     return DECODE_ABORT_LENGTH;
 
   unsigned num_bytes = bmsg->bits_per_row[0]/8;
+  if (num_bytes > sizeof(msg->frame))
+    return DECODE_ABORT_LENGTH;
   unsigned num_bits = bmsg->bits_per_row[0];
   unsigned ipos = 0;
   const uint8_t *bb = bmsg->bb[row];
@@ -348,14 +786,12 @@ int RAMSES::messageParse(RAMSESMessage *msg) {
   if (!checksum_ok)
       return DECODE_FAIL_MIC;
 
+  memcpy(msg->frame, bb, num_bytes);
+  msg->frame_length = num_bytes;
+
   msg->header = next(bb, &ipos, num_bytes);
 
-  msg->num_device_ids = msg->header == 0x14 ? 1 :
-                        msg->header == 0x18 ? 2 :
-                        msg->header == 0x1c ? 2 :
-                        msg->header == 0x10 ? 2 :
-                        msg->header == 0x3c ? 2 :
-              (msg->header >> 2) & 0x03; // total speculation.
+  msg->num_device_ids = header_num_device_ids(msg->header);
 
   for (unsigned i = 0; i < msg->num_device_ids; i++)
       for (unsigned j = 0; j < 3; j++)
@@ -363,458 +799,283 @@ int RAMSES::messageParse(RAMSESMessage *msg) {
 
   msg->command = (next(bb, &ipos, num_bytes) << 8) | next(bb, &ipos, num_bytes);
   msg->payload_length = next(bb, &ipos, num_bytes);
+  msg->payload_offset = ipos / 8;
 
-  for (unsigned i = 0; i < msg->payload_length; i++)
-      msg->payload[i] = next(bb, &ipos, num_bytes);
+  // a payload running past the message gets what next() makes of it, as long as it fits
+  if (msg->payload_offset + msg->payload_length > sizeof(msg->frame))
+      return DECODE_FAIL_SANITY;
+  for (unsigned i = 0; i < msg->payload_length; i++) {
+      unsigned at = ipos / 8;
+      msg->frame[at] = next(bb, &ipos, num_bytes);
+  }
 
+  msg->unparsed_offset = ipos / 8;
+  msg->unparsed_length = 0;
   if (ipos < num_bits - 8)
   {
     unsigned num_unparsed_bits = (bmsg->bits_per_row[row] - 8) - ipos;
     msg->unparsed_length = (num_unparsed_bits / 8) + (num_unparsed_bits % 8) ? 1 : 0;
-    if (msg->unparsed_length != 0)
-        bitbuffer_extract_bytes(bmsg, row, ipos, msg->unparsed, num_unparsed_bits);
   }
 
   return ipos;
 }
 
-enum fan_setting {
-    FAN_AWAY = 0,
-    FAN_1 = 1,
-    FAN_2 = 2,
-    FAN_3 = 3,
-    FAN_AUTO = 4
-};
-
-int RAMSES::messageInterpret(const RAMSESMessage *msg) {
-  Serial.println("RAMSES::messageInterpret");
-  const bitbuffer_t *bmsg = &msg->bits;
-  const int row = 0;
+//checks the fields of the opcodes it knows and hands the message to every
+//subscriber as the matching event; -1 if a known opcode does not check out
+int RAMSES::messageInterpret(const RAMSESMessage *msg, uint32_t timestamp, uint8_t rssi) {
+  RAMSESEvent base;
+  base.message = msg;
+  base.source = msg->num_device_ids > 0 ? RAMSESDevices::packId(msg->device_id[0]) : RAMSES_DEVICE_NONE;
+  base.destination = msg->num_device_ids > 1 ? RAMSESDevices::packId(msg->device_id[1]) : RAMSES_DEVICE_NONE;
+  base.timestamp = timestamp;
+  base.rssi = rssi;
+  const uint8_t *payload = msg->payload();
 
-  Serial.printf("- num_device_ids: %d\n", msg->num_device_ids);
-  for (unsigned i = 0; i < msg->num_device_ids; i++) {
-      Serial.printf("  %02x%02x%02x\n",
-                    msg->device_id[i][0],
-                    msg->device_id[i][1],
-                    msg->device_id[i][2]);
-  }
-
-  Serial.printf("- command: 0x%04x\n", msg->command);
   switch (msg->command) {
     case 0x22f1: {
-        if (msg->payload_length != 3)
-          return -1;
-        if (msg->payload[0] != 0)
+        if (msg->payload_length != 3 || payload[0] != 0 || payload[2] != 4)
           return -1;
-        if (msg->payload[2] != 4)
-          return -1;
-        switch (msg->payload[1]) {
-        case 0:
-            Serial.printf("  fan_setting: away\n");
-            break;
-        case 4:
-            Serial.printf("  fan_setting: auto\n");
-            break;
-        default:
-            Serial.printf("  fan_setting: %d\n", msg->payload[1]);
-        }
+        RAMSESFanSettingCommand event;
+        (RAMSESEvent &)event = base;
+        event.setting = payload[1];
+        for (uint8_t i = 0; i < numSubscribers; i++)
+          subscribers[i]->onFanSetting(event);
         break;
     }
     case 0x22f3: {
-        if (msg->payload_length != 7)
+        if (msg->payload_length != 7 || payload[0] != 0 || payload[1] != 2)
           return -1;
-        if (msg->payload[0] != 0)
-          return -1;
-        if (msg->payload[1] != 2)
-          return -1;
-        Serial.printf("  fan_timer_minutes: %d\n", msg->payload[2]);
-        switch (msg->payload[3]) {
-        case 0:
-            Serial.printf("  fan_setting: away\n");
-            break;
-        case 4:
-            Serial.printf("  fan_setting: auto\n");
-            break;
-        default:
-            Serial.printf("  fan_setting: %d\n", msg->payload[3]);
-        }
-        switch (msg->payload[4]) {
-        case 0:
-            Serial.printf("  fan_return_setting: away\n");
-            break;
-        case 4:
-            Serial.printf("  fan_return_setting: auto\n");
-            break;
-        default:
-            Serial.printf("  fan_return_setting: %d\n", msg->payload[4]);
-        }
+        RAMSESFanTimerCommand event;
+        (RAMSESEvent &)event = base;
+        event.minutes = payload[2];
+        event.setting = payload[3];
+        event.returnSetting = payload[4];
+        for (uint8_t i = 0; i < numSubscribers; i++)
+          subscribers[i]->onFanTimer(event);
         break;
     }
     case 0x31d9: {
         if (msg->payload_length != 4)
           return -1;
-        switch (msg->payload[2]) {
-        case 0:
-            Serial.printf("  fan_set_to: away\n");
-            break;
-        case 4:
-            Serial.printf("  fan_set_to: auto\n");
-            break;
-        default:
-            Serial.printf("  fan_set_to: %d\n", msg->payload[2]);
-        }
+        RAMSESFanStatus event;
+        (RAMSESEvent &)event = base;
+        event.setting = payload[2];
+        for (uint8_t i = 0; i < numSubscribers; i++)
+          subscribers[i]->onFanStatus(event);
         break;
     }
+    default: {
+        RAMSESUnknownMessage event;
+        (RAMSESEvent &)event = base;
+        event.opcode = msg->command;
+        event.payload = payload;
+        event.payloadLength = msg->payload_length;
+        for (uint8_t i = 0; i < numSubscribers; i++)
+          subscribers[i]->onUnknown(event);
+    }
   }
 
   return 1;
 }
 
-// void RAMSES::sendCommand(IthoCommand command)
-// {
-//   CC1101Packet outMessage;
-//   uint8_t maxTries = sendTries;
-//   uint8_t delaytime = 40;
-
-//   /*
-
-//   //update itho packet data
-//   outMessage.command = command;
-//   outMessage.counter += 1;
-
-//   //get message2 bytes
-//   switch (command)
-//   {
-//     case IthoJoin:
-//       createMessageJoin(&outMessage, &outMessage);
-//       break;
-
-//     case IthoLeave:
-//       createMessageLeave(&outMessage, &outMessage);
-//       //the leave command needs to be transmitted for 1 second according the manual
-//       maxTries = 30;
-//       delaytime = 4;
-//       break;
-
-//     default:
-//       createMessageCommand(&outMessage, &outMessage);
-//       break;
-//   }
-
-//   */
-
-//   //send messages
-//   for (int i = 0; i < maxTries; i++)
-//   {
-
-//     //message2
-//     initSendMessage(outMessage.length);
-//     sendData(&outMessage);
-
-//     finishTransfer();
-//     delay(delaytime);
-//   }
-//   initReceive();
-// }
-
-
-void RAMSES::createMessageStart(RAMSESMessage *itho, CC1101Packet *packet)
-{
+bool RAMSES::subscribe(RAMSESSubscriber *subscriber) {
+  if (numSubscribers == RAMSES_MAX_SUBSCRIBERS)
+    return false;
+  subscribers[numSubscribers++] = subscriber;
+  return true;
+}
 
-  //fixed, set start structure in data buffer manually
-  for (uint8_t i = 0; i < 7; i++) {
-    packet->data[i] = 170;
+void RAMSES::unsubscribe(RAMSESSubscriber *subscriber) {
+  for (uint8_t i = 0; i < numSubscribers; i++) {
+    if (subscribers[i] == subscriber) {
+      subscribers[i] = subscribers[--numSubscribers];
+      return;
+    }
   }
-  packet->data[7] = 171;
-  packet->data[8] = 254;
-  packet->data[9] = 0;
-  packet->data[10] = 179;
-  packet->data[11] = 42;
-  packet->data[12] = 171;
-  packet->data[13] = 42;
-
-  //[start of command specific data]
-
 }
 
-void RAMSES::createMessageCommand(RAMSESMessage *itho, CC1101Packet *packet)
+//FNV-1a over every message byte, header, addresses and checksum included:
+//a retransmission is the same frame, the same command to another fan is not
+uint32_t RAMSES::frameHash(const uint8_t *bytes, uint8_t length)
 {
-/*
-  //set start message structure
-  createMessageStart(itho, packet);
-
-  //set deviceType? (or messageType?), not sure what this is
-  itho->dataDecoded[0] = itho->deviceType;
+  uint32_t hash = 2166136261u;
 
-  //set deviceID
-  itho->dataDecoded[1] = itho->deviceId[0];
-  itho->dataDecoded[2] = itho->deviceId[1];
-  itho->dataDecoded[3] = itho->deviceId[2];
-
-  //set counter1
-  itho->dataDecoded[4] = itho->counter;
+  for (uint8_t i = 0; i < length; i++)
+    hash = (hash ^ bytes[i]) * 16777619u;
+  return hash;
+}
 
-  //set command bytes on dataDecoded[5 - 10]
-  uint8_t *commandBytes = getMessageCommandBytes(itho->command);
-  for (uint8_t i = 0; i < 6; i++) {
-    itho->dataDecoded[i + 5] = commandBytes[i];
+//remember the frame; true if it was seen less than dedupWindow ms ago (counting from its last copy)
+bool RAMSES::isDuplicate(uint32_t hash, uint32_t timestamp)
+{
+  if (dedupWindow == 0) {
+    framesUnique++;
+    return false;
   }
 
-  //set counter2
-  itho->dataDecoded[11] = getCounter2(itho, 11);
-
-  itho->length = 12;
+  uint32_t window = dedupWindow * 1000UL;
+  RAMSESDedupEntry *oldest = &dedupCache[0];
 
-  packet->length = messageEncode(itho, packet);
-  packet->length += 1;
+  for (uint8_t i = 0; i < RAMSES_DEDUP_SIZE; i++) {
+    RAMSESDedupEntry *entry = &dedupCache[i];
+    uint32_t age = timestamp - entry->timestamp;
 
-  //set end byte
-  packet->data[packet->length] = 172;
-  packet->length += 1;
-
-  //set end 'noise'
-  for (uint8_t i = packet->length; i < packet->length + 7; i++) {
-    packet->data[i] = 170;
+    if (entry->used && entry->hash == hash && age < window) {
+      entry->timestamp = timestamp;
+      framesDuplicate++;
+      return true;
+    }
+    if (!entry->used || (oldest->used && age > timestamp - oldest->timestamp))
+      oldest = entry;
   }
-  packet->length += 7;
-  */
 
+  oldest->used = true;
+  oldest->hash = hash;
+  oldest->timestamp = timestamp;
+  framesUnique++;
+  return false;
 }
 
-void RAMSES::createMessageJoin(RAMSESMessage *itho, CC1101Packet *packet)
+void RAMSES::sendCommand(IthoCommand command)
 {
-/*
-  //set start message structure
-  createMessageStart(itho, packet);
-
-  //set deviceType? (or messageType?)
-  itho->dataDecoded[0] = itho->deviceType;
+  uint8_t maxTries = sendTries;
+  uint8_t delaytime = 40;
 
-  //set deviceID
-  itho->dataDecoded[1] = itho->deviceId[0];
-  itho->dataDecoded[2] = itho->deviceId[1];
-  itho->dataDecoded[3] = itho->deviceId[2];
-
-  //set counter1
-  itho->dataDecoded[4] = itho->counter;
-
-  //set command bytes on dataDecoded[5 - ?]
-  uint8_t *commandBytes = getMessageCommandBytes(itho->command);
-  for (uint8_t i = 0; i < 6; i++) {
-    itho->dataDecoded[i + 5] = commandBytes[i];
+  if (command == IthoLeave)
+  {
+    //the leave command needs to be transmitted for 1 second according the manual
+    maxTries = 30;
+    delaytime = 4;
   }
 
-  //set deviceID
-  itho->dataDecoded[11] = itho->deviceId[0];
-  itho->dataDecoded[12] = itho->deviceId[1];
-  itho->dataDecoded[13] = itho->deviceId[2];
-
-  itho->dataDecoded[14] = 1;
-  itho->dataDecoded[15] = 16;
-  itho->dataDecoded[16] = 224;
-
-  //set deviceID
-  itho->dataDecoded[17] = itho->deviceId[0];
-  itho->dataDecoded[18] = itho->deviceId[1];
-  itho->dataDecoded[19] = itho->deviceId[2];
-
-  //set counter2
-  itho->dataDecoded[20] = getCounter2(itho, 20);
-
-  itho->length = 21;
+  CC1101Packet *outPacket = commandPacket(command);
+  if (!outPacket || outPacket->length == 0)
+    return;
 
-  packet->length = messageEncode(itho, packet);
-  packet->length += 1;
-
-  //set end byte
-  packet->data[packet->length] = 202;
-  packet->length += 1;
-
-  //set end 'noise'
-  for (uint8_t i = packet->length; i < packet->length + 7; i++) {
-    packet->data[i] = 170;
+  //send messages
+  for (int i = 0; i < maxTries; i++)
+  {
+    sendPacket(outPacket);
+    delay(delaytime);
   }
-  packet->length += 7;
-*/
 }
 
-void RAMSES::createMessageLeave(RAMSESMessage *itho, CC1101Packet *packet)
+//encoded frame for a command from the current IDs, from the cache when it was sent before;
+//NULL for commands without a known frame
+CC1101Packet *RAMSES::commandPacket(IthoCommand command)
 {
-/*
-  //set start message structure
-  createMessageStart(itho, packet);
-
-  //set deviceType? (or messageType?)
-  itho->dataDecoded[0] = itho->deviceType;
+  //standby has no command table yet (all zeros would go out as opcode 0000), unknown is no command at all
+  if (command == IthoUnknown || command == IthoStandby)
+    return NULL;
 
-  //set deviceID
-  itho->dataDecoded[1] = itho->deviceId[0];
-  itho->dataDecoded[2] = itho->deviceId[1];
-  itho->dataDecoded[3] = itho->deviceId[2];
+  const uint8_t *source = outMessage.device_id[0];
+  const uint8_t *destination = outMessage.device_id[1];
 
-  //set counter1
-  itho->dataDecoded[4] = itho->counter;
-
-  //set command bytes on dataDecoded[5 - 10]
-  uint8_t *commandBytes = getMessageCommandBytes(itho->command);
-  for (uint8_t i = 0; i < 6; i++) {
-    itho->dataDecoded[i + 5] = commandBytes[i];
+  //RAMSES frames carry no sequence counter, so an image stays valid as long as its IDs do
+  for (uint8_t i = 0; i < RAMSES_TX_CACHE_SIZE; i++)
+  {
+    RAMSESTxCacheEntry *entry = &txCache[i];
+    if (entry->packet.length && entry->command == command
+        && memcmp(entry->source, source, 3) == 0 && memcmp(entry->destination, destination, 3) == 0)
+    {
+      txCacheHits++;
+      return &entry->packet;
+    }
   }
 
-  //set deviceID
-  itho->dataDecoded[11] = itho->deviceId[0];
-  itho->dataDecoded[12] = itho->deviceId[1];
-  itho->dataDecoded[13] = itho->deviceId[2];
-
-  //set counter2
-  itho->dataDecoded[14] = getCounter2(itho, 14);
-
-  itho->length = 15;
+  //miss: encode into the oldest slot
+  RAMSESTxCacheEntry *entry = &txCache[txCacheNext];
+  txCacheNext = (txCacheNext + 1) % RAMSES_TX_CACHE_SIZE;
+  txCacheMisses++;
 
-  packet->length = messageEncode(itho, packet);
-  packet->length += 1;
+  switch (command)
+  {
+    case IthoJoin:
+      createMessageJoin(&outMessage, &entry->packet);
+      break;
 
-  //set end byte
-  packet->data[packet->length] = 202;
-  packet->length += 1;
+    case IthoLeave:
+      createMessageLeave(&outMessage, &entry->packet);
+      break;
 
-  //set end 'noise'
-  for (uint8_t i = packet->length; i < packet->length + 7; i++) {
-    packet->data[i] = 170;
+    default:
+      createMessageCommand(&outMessage, &entry->packet, command);
+      break;
   }
-  packet->length += 7;
-*/
+  entry->command = command;
+  memcpy(entry->source, source, 3);
+  memcpy(entry->destination, destination, 3);
+  return &entry->packet;
 }
 
-// uint8_t* RAMSES::getMessageCommandBytes(IthoCommand command)
-// {
-//   switch (command)
-//   {
-//     case IthoStandby:
-//       return (uint8_t*)&ithoMessageStandByCommandBytes[0];
-//     case IthoHigh:
-//       return (uint8_t*)&ithoMessageHighCommandBytes[0];
-//     case IthoFull:
-//       return (uint8_t*)&ithoMessageFullCommandBytes[0];
-//     case IthoMedium:
-//       return (uint8_t*)&ithoMessageMediumCommandBytes[0];
-//     case IthoLow:
-//       return (uint8_t*)&ithoMessageLowCommandBytes[0];
-//     case IthoTimer1:
-//       return (uint8_t*)&ithoMessageTimer1CommandBytes[0];
-//     case IthoTimer2:
-//       return (uint8_t*)&ithoMessageTimer2CommandBytes[0];
-//     case IthoTimer3:
-//       return (uint8_t*)&ithoMessageTimer3CommandBytes[0];
-//     case IthoJoin:
-//       return (uint8_t*)&ithoMessageJoinCommandBytes[0];
-//     case IthoLeave:
-//       return (uint8_t*)&ithoMessageLeaveCommandBytes[0];
-//     default:
-//       return (uint8_t*)&ithoMessageLowCommandBytes[0];
-//   }
-// }
-
-/*
-   Counter2 is the decimal sum of all bytes in decoded form from
-   deviceType up to the last byte before counter2 subtracted
-   from zero.
-*/
-/*
-uint8_t RAMSES::getCounter2(RAMSESMessage *itho, uint8_t len) {
-
-  uint8_t val = 0;
-
-  for (uint8_t i = 0; i < len; i++) {
-    val += itho->dataDecoded[i];
-  }
-
-  return 0 - val;
+//set header, addresses and the opcode, length and first payload bytes from a command table
+void RAMSES::createMessageStart(RAMSESMessage *itho, const uint8_t commandBytes[])
+{
+  itho->header = 0x18;          // I, source and destination address
+  itho->num_device_ids = 2;
+  itho->command = commandBytes[0] << 8 | commandBytes[1];
+  itho->payload_length = commandBytes[2];
+  itho->layoutPayload();
+  memcpy(itho->payload(), &commandBytes[3], 3);
 }
-*/
-
-uint8_t RAMSES::messageEncode(const RAMSESMessage *itho, CC1101Packet *packet) {
-
-/*
-  uint8_t lenOutbuf = 0;
-
-  if ((itho->length * 20) % 8 == 0) { //inData len fits niecly in out buffer length
-    lenOutbuf = itho->length * 2.5;
-  }
-  else { //is this an issue? inData last byte does not fill out buffer length, add 1 out byte extra, padding is done after encode
-    lenOutbuf = (uint8_t)(itho->length * 2.5) + 0.5;
-  }
 
-  uint8_t out_bytecounter = 14;   //index of Outbuf, start at offset 14, first part of the message is set manually
-  uint8_t out_bitcounter = 0;     //bit position of current outbuf byte
-  uint8_t out_patterncounter = 0; //bit counter to add 1 0 bit pattern after every 8 bits
-  uint8_t bitSelect = 4;          //bit position of the inData byte (4 - 7, 0 - 3)
-  uint8_t out_shift = 7;          //bit shift inData bit in position of outbuf byte
-
-  //we need to zero the out buffer first cause we are using bitshifts
-  for (int i = out_bytecounter; i < sizeof(packet->data) / sizeof(packet->data[0]); i++) {
-    packet->data[i] = 0;
-  }
-
-  for (uint8_t dataByte = 0; dataByte < itho->length; dataByte++) {
-    for (uint8_t dataBit = 0; dataBit < 8; dataBit++) {                                     //process a full dataByte at a time resulting in 20 output bits (2.5 bytes) with the pattern 7x6x5x4x 10 3x2x1x0x 10 7x6x5x4x 10 3x2x1x0x 10 etc
-      if (out_bitcounter == 8) {                                                            //check if new byte is needed
-        out_bytecounter++;
-        out_bitcounter = 0;
-      }
+void RAMSES::createMessageCommand(RAMSESMessage *itho, CC1101Packet *packet, IthoCommand command)
+{
+  createMessageStart(itho, getMessageCommandBytes(command));
+  packet->length = messageEncode(itho, packet);
+}
 
-      if (out_patterncounter == 8) {                                                        //check if we have to start with a 1 0 pattern
-        out_patterncounter = 0;
-        packet->data[out_bytecounter] = packet->data[out_bytecounter] | 1 << out_shift;
-        out_shift--;
-        out_bitcounter++;
-        packet->data[out_bytecounter] = packet->data[out_bytecounter] | 0 << out_shift;
-        if (out_shift == 0) out_shift = 8;
-        out_shift--;
-        out_bitcounter++;
-      }
+void RAMSES::createMessageJoin(RAMSESMessage *itho, CC1101Packet *packet)
+{
+  createMessageStart(itho, ithoMessageJoinCommandBytes);
 
-      if (out_bitcounter == 8) {                                                            //check if new byte is needed
-        out_bytecounter++;
-        out_bitcounter = 0;
-      }
+  //00 22F1 <id> 01 10E0 <id>
+  memcpy(&itho->payload()[3], itho->device_id[0], 3);
+  itho->payload()[6] = 1;
+  itho->payload()[7] = 16;
+  itho->payload()[8] = 224;
+  memcpy(&itho->payload()[9], itho->device_id[0], 3);
 
-      //set the even bit
-      uint8_t bit = (itho->dataDecoded[dataByte] & (1 << bitSelect)) >> bitSelect;          //select bit and shift to bit pos 0
-      bitSelect++;
-      if (bitSelect == 8) bitSelect = 0;
+  packet->length = messageEncode(itho, packet);
+}
 
-      packet->data[out_bytecounter] = packet->data[out_bytecounter] | bit << out_shift;     //shift bit in corect pos of current outbuf byte
-      out_shift--;
-      out_bitcounter++;
-      out_patterncounter++;
+void RAMSES::createMessageLeave(RAMSESMessage *itho, CC1101Packet *packet)
+{
+  createMessageStart(itho, ithoMessageLeaveCommandBytes);
 
-      //set the odd bit (inverse of even bit)
-      bit = ~bit & 0b00000001;
-      packet->data[out_bytecounter] = packet->data[out_bytecounter] | bit << out_shift;
-      if (out_shift == 0) out_shift = 8;
-      out_shift--;
-      out_bitcounter++;
-      out_patterncounter++;
+  //00 1FC9 <id>
+  memcpy(&itho->payload()[3], itho->device_id[0], 3);
 
-    }
+  packet->length = messageEncode(itho, packet);
+}
 
+const uint8_t *RAMSES::getMessageCommandBytes(IthoCommand command)
+{
+  switch (command)
+  {
+    case IthoStandby:
+      return ithoMessageStandByCommandBytes;
+    case IthoHigh:
+      return ithoMessageHighCommandBytes;
+    case IthoFull:
+      return ithoMessageFullCommandBytes;
+    case IthoMedium:
+      return ithoMessageMediumCommandBytes;
+    case IthoLow:
+      return ithoMessageLowCommandBytes;
+    case IthoTimer1:
+      return ithoMessageTimer1CommandBytes;
+    case IthoTimer2:
+      return ithoMessageTimer2CommandBytes;
+    case IthoTimer3:
+      return ithoMessageTimer3CommandBytes;
+    case IthoJoin:
+      return ithoMessageJoinCommandBytes;
+    case IthoLeave:
+      return ithoMessageLeaveCommandBytes;
+    default:
+      return ithoMessageLowCommandBytes;
   }
-  if (out_bitcounter < 8) {                                                                   //add closing 1 0 pattern to fill last packet->data byte and ensure DC balance in the message
-    for (uint8_t i = out_bitcounter; i < 8; i += 2) {
-      packet->data[out_bytecounter] = packet->data[out_bytecounter] | 1 << out_shift;
-      out_shift--;
-      packet->data[out_bytecounter] = packet->data[out_bytecounter] | 0 << out_shift;
-      if (out_shift == 0) out_shift = 8;
-      out_shift--;
-    }
-  }
-
-  return out_bytecounter;
-
-  */
-
-  return 0;
 }
 
 void print_buffer(uint8_t *data, uint8_t len, const char* tag) {
@@ -844,7 +1105,78 @@ static int decode_10to8(uint8_t const *b, int pos, int end, uint8_t *out)
     return 10;
 }
 
-int RAMSES::messageDecode(const CC1101Packet *packet, RAMSESMessage *msg) {
+// Bit reversal of a byte: symbols carry their data bits LSB first.
+static const uint8_t bit_reverse[256] = {
+    0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0, 0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
+    0x08, 0x88, 0x48, 0xc8, 0x28, 0xa8, 0x68, 0xe8, 0x18, 0x98, 0x58, 0xd8, 0x38, 0xb8, 0x78, 0xf8,
+    0x04, 0x84, 0x44, 0xc4, 0x24, 0xa4, 0x64, 0xe4, 0x14, 0x94, 0x54, 0xd4, 0x34, 0xb4, 0x74, 0xf4,
+    0x0c, 0x8c, 0x4c, 0xcc, 0x2c, 0xac, 0x6c, 0xec, 0x1c, 0x9c, 0x5c, 0xdc, 0x3c, 0xbc, 0x7c, 0xfc,
+    0x02, 0x82, 0x42, 0xc2, 0x22, 0xa2, 0x62, 0xe2, 0x12, 0x92, 0x52, 0xd2, 0x32, 0xb2, 0x72, 0xf2,
+    0x0a, 0x8a, 0x4a, 0xca, 0x2a, 0xaa, 0x6a, 0xea, 0x1a, 0x9a, 0x5a, 0xda, 0x3a, 0xba, 0x7a, 0xfa,
+    0x06, 0x86, 0x46, 0xc6, 0x26, 0xa6, 0x66, 0xe6, 0x16, 0x96, 0x56, 0xd6, 0x36, 0xb6, 0x76, 0xf6,
+    0x0e, 0x8e, 0x4e, 0xce, 0x2e, 0xae, 0x6e, 0xee, 0x1e, 0x9e, 0x5e, 0xde, 0x3e, 0xbe, 0x7e, 0xfe,
+    0x01, 0x81, 0x41, 0xc1, 0x21, 0xa1, 0x61, 0xe1, 0x11, 0x91, 0x51, 0xd1, 0x31, 0xb1, 0x71, 0xf1,
+    0x09, 0x89, 0x49, 0xc9, 0x29, 0xa9, 0x69, 0xe9, 0x19, 0x99, 0x59, 0xd9, 0x39, 0xb9, 0x79, 0xf9,
+    0x05, 0x85, 0x45, 0xc5, 0x25, 0xa5, 0x65, 0xe5, 0x15, 0x95, 0x55, 0xd5, 0x35, 0xb5, 0x75, 0xf5,
+    0x0d, 0x8d, 0x4d, 0xcd, 0x2d, 0xad, 0x6d, 0xed, 0x1d, 0x9d, 0x5d, 0xdd, 0x3d, 0xbd, 0x7d, 0xfd,
+    0x03, 0x83, 0x43, 0xc3, 0x23, 0xa3, 0x63, 0xe3, 0x13, 0x93, 0x53, 0xd3, 0x33, 0xb3, 0x73, 0xf3,
+    0x0b, 0x8b, 0x4b, 0xcb, 0x2b, 0xab, 0x6b, 0xeb, 0x1b, 0x9b, 0x5b, 0xdb, 0x3b, 0xbb, 0x7b, 0xfb,
+    0x07, 0x87, 0x47, 0xc7, 0x27, 0xa7, 0x67, 0xe7, 0x17, 0x97, 0x57, 0xd7, 0x37, 0xb7, 0x77, 0xf7,
+    0x0f, 0x8f, 0x4f, 0xcf, 0x2f, 0xaf, 0x6f, 0xef, 0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff,
+};
+
+// Start (0) and stop (1) bits of four consecutive symbols in a 40-bit group.
+#define SYMBOLS4_FRAME_MASK   0x8060180601ULL
+#define SYMBOLS4_FRAME_VALUE  0x0040100401ULL
+
+/// Read 40 bits starting at (possibly unaligned) bit_idx, first bit in bit 39.
+static inline uint64_t bitrow_get_bits40(uint8_t const *bitrow, unsigned bit_idx)
+{
+    uint8_t const *p = &bitrow[bit_idx >> 3];
+    unsigned shift   = bit_idx & 7;
+    uint64_t word    = (uint64_t)p[0] << 32 | (uint64_t)p[1] << 24 | (uint64_t)p[2] << 16
+                     | (uint64_t)p[3] << 8 | p[4];
+
+    if (shift)
+        word = (word << shift | p[5] >> (8 - shift)) & 0xFFFFFFFFFFULL;
+    return word;
+}
+
+/// Decode consecutive 10-bit symbols from bit pos up to end into whole bytes,
+/// four symbols per 40-bit group. Stops at the first symbol with a bad start
+/// or stop bit, or when less than 10 bits remain. Returns the number of bytes.
+static unsigned decode_10to8_row(uint8_t const *b, unsigned pos, unsigned end,
+        uint8_t *out, unsigned max_bytes)
+{
+    unsigned n = 0;
+
+    while (pos + 40 <= end && n + 4 <= max_bytes) {
+        uint64_t word = bitrow_get_bits40(b, pos);
+        if ((word & SYMBOLS4_FRAME_MASK) != SYMBOLS4_FRAME_VALUE)
+            break; // let the symbol loop below find the bad one
+
+        out[n++] = bit_reverse[(word >> 31) & 0xFF];
+        out[n++] = bit_reverse[(word >> 21) & 0xFF];
+        out[n++] = bit_reverse[(word >> 11) & 0xFF];
+        out[n++] = bit_reverse[(word >> 1) & 0xFF];
+        pos += 40;
+    }
+
+    while (n < max_bytes) {
+        uint8_t byte;
+        if (decode_10to8(b, pos, end, &byte) != 10)
+            break;
+        out[n++] = bit_reverse[byte];
+        pos += 10;
+    }
+
+    return n;
+}
+
+// Multi-stage decoder: copies the packet into a bitbuffer, decodes the
+// symbols into a second one and Manchester decodes into bits for
+// messageParseReference(). Kept as the reference for messageDecode().
+int RAMSES::messageDecodeReference(const CC1101Packet *packet, bitbuffer_t *bits) {
   // create a bit buffer
   // TODO: view?
   bitbuffer_t bitbuffer = {0};
@@ -854,8 +1186,7 @@ int RAMSES::messageDecode(const CC1101Packet *packet, RAMSESMessage *msg) {
     }
   }
 
-  Serial.printf("raw packet: ");
-  bitbuffer_print(&bitbuffer);
+  RAMSES_LOG_DATA(logRing, RAMSES_LOG_DEBUG, RAMSES_LOG_RAW_PACKET, 0, 0, 0, packet->data, packet->length);
 
   // preamble=0x55 0xFF 0x00
   // preamble with start/stop bits=0101010101 0111111111 0000000001
@@ -877,15 +1208,9 @@ int RAMSES::messageDecode(const CC1101Packet *packet, RAMSESMessage *msg) {
   int end = start + len;
 
   bitbuffer_t bytes = {0};
-  int pos = start;
-  while (pos < end) {
-      uint8_t byte = 0;
-      if (decode_10to8(bitbuffer.bb[row], pos, end, &byte) != 10)
-          break;
-      for (unsigned i = 0; i < 8; i++)
-          bitbuffer_add_bit(&bytes, (byte >> i) & 0x1);
-      pos += 10;
-  }
+  unsigned num_bytes = decode_10to8_row(bitbuffer.bb[row], start, end, bytes.bb[row], BITBUF_COLS);
+  bytes.num_rows = bytes.free_row = 1;
+  bytes.bits_per_row[row] = num_bytes * 8;
 
   // Skip Manchester breaking header
   uint8_t header[3] = { 0x33, 0x55, 0x53 };
@@ -909,8 +1234,8 @@ int RAMSES::messageDecode(const CC1101Packet *packet, RAMSESMessage *msg) {
   unsigned num_bits   = end_byte - first_byte;
   //unsigned num_bytes = num_bits/8 / 2;
 
-  bitbuffer_clear(&msg->bits);
-  unsigned fpos = bitbuffer_manchester_decode(&bytes, row, first_byte, &msg->bits, num_bits);
+  bitbuffer_clear(bits);
+  unsigned fpos = bitbuffer_manchester_decode(&bytes, row, first_byte, bits, num_bits);
   unsigned man_errors = num_bits - (fpos - first_byte - 2);
 
 #ifndef _DEBUG
@@ -918,12 +1243,430 @@ int RAMSES::messageDecode(const CC1101Packet *packet, RAMSESMessage *msg) {
       return DECODE_FAIL_SANITY;
 #endif
 
-  Serial.printf("raw message: ");
-  bitbuffer_print(&msg->bits);
+  RAMSES_LOG_DATA(logRing, RAMSES_LOG_DEBUG, RAMSES_LOG_RAW_MESSAGE, 0, 0, 0, bits->bb[row], bits->bits_per_row[row] / 8);
 
   return 1;
 }
 
+/// Pulls the 10-to-8 decoded symbols off a bit row, four at a time.
+struct symbol_reader {
+    uint8_t const *bitrow;
+    unsigned pos;
+    unsigned end;
+    unsigned count;
+    unsigned next;
+    uint8_t buf[4];
+};
+
+static bool symbol_next(struct symbol_reader *r, uint8_t *out)
+{
+    if (r->next == r->count) {
+        r->count = decode_10to8_row(r->bitrow, r->pos, r->end, r->buf, 4);
+        r->pos += 10 * r->count;
+        r->next = 0;
+        if (r->count == 0)
+            return false;
+    }
+    *out = r->buf[r->next++];
+    return true;
+}
+
+/// Stores each decoded message byte in the RAMSESMessage frame as it
+/// arrives, filling in the fields and keeping a running checksum.
+struct message_parser {
+    RAMSESMessage *msg;
+    unsigned num_bytes;
+    uint8_t sum;
+    uint8_t last;
+};
+
+static void message_parser_init(struct message_parser *p, RAMSESMessage *msg)
+{
+    p->msg = msg;
+    p->num_bytes = 0;
+    p->sum = 0;
+    p->last = 0;
+
+    msg->frame_length = 0;
+    msg->header = 0;
+    msg->num_device_ids = 0;
+    msg->command = 0;
+    msg->payload_offset = 0;
+    msg->payload_length = 0;
+    msg->unparsed_offset = 0;
+    msg->unparsed_length = 0;
+    msg->crc = 0;
+}
+
+static void message_parser_add(struct message_parser *p, uint8_t byte)
+{
+    RAMSESMessage *msg = p->msg;
+    unsigned i = p->num_bytes++;
+
+    p->sum += byte;
+    p->last = byte;
+
+    // too long is caught by message_parser_finish()
+    if (i >= sizeof(msg->frame))
+        return;
+    msg->frame[i] = byte;
+
+    if (i == 0) {
+        msg->header = byte;
+        msg->num_device_ids = header_num_device_ids(byte);
+        return;
+    }
+    i -= 1;
+    if (i < 3u * msg->num_device_ids) {
+        msg->device_id[i / 3][i % 3] = byte;
+        return;
+    }
+    i -= 3 * msg->num_device_ids;
+    switch (i) {
+    case 0:
+        msg->command = byte << 8;
+        return;
+    case 1:
+        msg->command |= byte;
+        return;
+    case 2:
+        msg->payload_length = byte;
+        msg->payload_offset = p->num_bytes;
+        return;
+    }
+}
+
+static int message_parser_finish(struct message_parser *p)
+{
+    RAMSESMessage *msg = p->msg;
+
+    if (p->num_bytes == 0)
+        return DECODE_ABORT_LENGTH;
+
+    // Checksum: All bytes add up to 0.
+    msg->crc = p->last;
+    if (p->sum != 0)
+        return DECODE_FAIL_MIC;
+
+    if (p->num_bytes > sizeof(msg->frame))
+        return DECODE_FAIL_SANITY;
+    msg->frame_length = p->num_bytes;
+
+    // the last byte is the checksum, the fields have to fit before it
+    unsigned fields = 1 + 3 * msg->num_device_ids + 3 + msg->payload_length;
+    if (fields > p->num_bytes - 1)
+        return DECODE_FAIL_SANITY;
+    msg->unparsed_offset = fields;
+    msg->unparsed_length = p->num_bytes - 1 - fields;
+
+    return p->num_bytes;
+}
+
+// Single pass decoder: finds the preamble in packet->data, decodes the
+// symbols, checks the header, Manchester decodes and parses the message
+// fields while summing the checksum, without intermediate buffers.
+// Returns the number of message bytes, or a decode_return_codes value.
+int RAMSES::messageDecode(const CC1101Packet *packet, RAMSESMessage *msg) {
+  uint8_t const *bitrow = packet->data;
+  unsigned bit_len = packet->length * 8;
+
+  RAMSES_LOG_DATA(logRing, RAMSES_LOG_DEBUG, RAMSES_LOG_RAW_PACKET, 0, 0, 0, packet->data, packet->length);
+
+  // see messageDecodeReference() for the preamble pattern
+  const uint8_t preamble_pattern[3] = { 0xFE, 0x00, 0x80 };
+  const unsigned preamble_bit_length = 17;
+
+  unsigned start = bitrow_search(bitrow, bit_len, 0, preamble_pattern, preamble_bit_length) + preamble_bit_length;
+  if (start + 8 > bit_len)
+      return DECODE_ABORT_LENGTH;
+
+  struct symbol_reader symbols = { bitrow, start, bit_len, 0, 0, {0} };
+  uint8_t symbol;
+
+  // Manchester breaking header
+  const uint8_t header[3] = { 0x33, 0x55, 0x53 };
+  for (unsigned i = 0; i < 3; i++) {
+      if (!symbol_next(&symbols, &symbol) || symbol != header[i])
+          return DECODE_FAIL_SANITY;
+  }
+
+  struct message_parser parser;
+  message_parser_init(&parser, msg);
+
+  // Manchester encoded message, two symbols per byte, up to the first
+  // symbol that is not valid Manchester (a trailing nibble is dropped)
+  uint8_t high = 0;
+  bool have_high = false;
+  for (;;) {
+      if (!symbol_next(&symbols, &symbol))
+          return DECODE_FAIL_SANITY;
+      uint8_t nibble = manchester_lut[symbol];
+      if (nibble & 0xF0)
+          break;
+      if (have_high)
+          message_parser_add(&parser, high << 4 | nibble);
+      else
+          high = nibble;
+      have_high = !have_high;
+  }
+
+  // Footer 0x35 (0x55*)
+  if (symbol != 0x35)
+      return DECODE_FAIL_SANITY;
+  while (symbol_next(&symbols, &symbol)) {
+      if (symbol != 0x55)
+          return DECODE_FAIL_SANITY;
+  }
+
+  return message_parser_finish(&parser);
+}
+
+// Places the fields of already Manchester decoded message bytes, see
+// RAMSESStreamDecoder. Returns the number of message bytes, or a
+// decode_return_codes value.
+int RAMSES::messageParse(const uint8_t *bytes, uint8_t length, RAMSESMessage *msg) {
+  struct message_parser parser;
+  message_parser_init(&parser, msg);
+
+  for (unsigned i = 0; i < length; i++)
+      message_parser_add(&parser, bytes[i]);
+
+  return message_parser_finish(&parser);
+}
+
+enum stream_decoder_states {
+    STREAM_PREAMBLE,
+    STREAM_HEADER,
+    STREAM_MESSAGE,
+    STREAM_DONE,
+};
+
+void RAMSESStreamDecoder::reset() {
+  state = STREAM_PREAMBLE;
+  result = 0;
+  reason = RAMSES_STATS;
+  acc = 0;
+  bits = 0;
+  symbols = 0;
+  high = 0;
+  haveHigh = false;
+  numBytes = 0;
+  lengthIndex = 0;
+  sum = 0;
+  expected = 0;
+  length = 0;
+}
+
+// Same checks as messageDecode(), a symbol at a time: the preamble pattern
+// right after the sync word, the 0x33 0x55 0x53 header, valid symbol framing
+// and Manchester up to the 0x35 trailer, and the checksum. Unlike
+// messageDecode() there can be no unparsed bytes: the trailer has to follow
+// the checksum where the payload length puts it. The first failure is
+// final, later bytes are ignored.
+int RAMSESStreamDecoder::feed(const uint8_t *data, uint8_t count) {
+  // 17 bit preamble pattern FE 00 80, see messageDecodeReference()
+  const uint32_t preamble = 0x1FC01;
+  const unsigned preamble_bit_length = 17;
+
+  for (unsigned i = 0; i < count && state != STREAM_DONE; i++) {
+      acc = acc << 8 | data[i];
+      bits += 8;
+
+      if (state == STREAM_PREAMBLE) {
+          if (bits < preamble_bit_length)
+              continue;
+          bits -= preamble_bit_length;
+          if ((acc >> bits & 0x1FFFF) != preamble)
+              return reject(DECODE_FAIL_SANITY, RAMSES_STAT_PREAMBLE);
+          state = STREAM_HEADER;
+      }
+
+      while (bits >= 10 && state != STREAM_DONE) {
+          bits -= 10;
+          unsigned framed = acc >> bits & 0x3FF;
+          // start bit 0, stop bit 1
+          if ((framed & 0x201) != 0x001)
+              return reject(DECODE_FAIL_SANITY, RAMSES_STAT_MANCHESTER);
+          symbol(bit_reverse[framed >> 1 & 0xFF]);
+      }
+      acc &= (1u << bits) - 1;
+  }
+  return result;
+}
+
+void RAMSESStreamDecoder::symbol(uint8_t value) {
+  if (state == STREAM_HEADER) {
+      // Manchester breaking header
+      const uint8_t header[3] = { 0x33, 0x55, 0x53 };
+      if (value != header[symbols])
+          reject(DECODE_FAIL_SANITY, RAMSES_STAT_HEADER);
+      else if (++symbols == 3)
+          state = STREAM_MESSAGE;
+      return;
+  }
+
+  uint8_t nibble = manchester_lut[value];
+  if (nibble & 0xF0) {
+      // the first non-Manchester symbol ends the message (a trailing nibble
+      // is dropped), and has to be the 0x35 footer
+      if (value != 0x35)
+          reject(DECODE_FAIL_SANITY, RAMSES_STAT_MANCHESTER);
+      else if (numBytes == 0)
+          reject(DECODE_ABORT_LENGTH, RAMSES_STAT_LENGTH);
+      else if (sum != 0)
+          reject(DECODE_FAIL_MIC, RAMSES_STAT_MIC);
+      else if (numBytes != expected)
+          reject(DECODE_FAIL_SANITY, RAMSES_STAT_TRAILER);    // the fields have to fit before the checksum
+      else
+          finish(numBytes);
+      return;
+  }
+  if (!haveHigh) {
+      high = nibble;
+      haveHigh = true;
+      return;
+  }
+  haveHigh = false;
+
+  if (numBytes == sizeof(bytes)) {
+      reject(DECODE_ABORT_LENGTH, RAMSES_STAT_LENGTH);
+      return;
+  }
+  // the receiver stops reading where the payload length says the frame ends
+  if (expected && numBytes == expected) {
+      reject(DECODE_FAIL_SANITY, RAMSES_STAT_TRAILER);
+      return;
+  }
+  uint8_t byte = high << 4 | nibble;
+  bytes[numBytes++] = byte;
+  sum += byte;
+
+  // header, device IDs, opcode, payload length: now the frame length is known
+  if (numBytes == 1)
+      lengthIndex = 1 + 3 * header_num_device_ids(byte) + 2;
+  else if (numBytes == lengthIndex + 1) {
+      // preamble pattern, header symbols, two symbols per byte (checksum included), trailer
+      expected = lengthIndex + 1 + byte + 1;
+      length = (17 + 10 * (3 + 2 * expected + 1) + 7) / 8;
+  }
+}
+
+int RAMSESStreamDecoder::finish(int code) {
+  state = STREAM_DONE;
+  result = code;
+  return code;
+}
+
+int RAMSESStreamDecoder::reject(int code, uint8_t stat) {
+  reason = stat;
+  return finish(code);
+}
+
+// Manchester encoding of a nibble, MSB first: 1 -> 01, 0 -> 10 (the inverse of manchester_lut)
+static const uint8_t manchester_encode_lut[16] = {
+    0xaa, 0xa9, 0xa6, 0xa5, 0x9a, 0x99, 0x96, 0x95,
+    0x6a, 0x69, 0x66, 0x65, 0x5a, 0x59, 0x56, 0x55,
+};
+
+/// Packs bits MSB first into bytes; the inverse of symbol_reader.
+struct symbol_writer {
+    uint8_t *out;
+    unsigned len;   ///< whole bytes written so far
+    unsigned max;
+    uint32_t acc;   ///< pending bits, right aligned
+    unsigned bits;  ///< number of pending bits, < 8 between calls
+    bool overflow;
+};
+
+static void symbol_writer_bits(struct symbol_writer *w, uint32_t value, unsigned n)
+{
+    w->acc = w->acc << n | value;
+    w->bits += n;
+    while (w->bits >= 8) {
+        w->bits -= 8;
+        if (w->len < w->max)
+            w->out[w->len++] = w->acc >> w->bits;
+        else
+            w->overflow = true;
+    }
+    w->acc &= (1u << w->bits) - 1;
+}
+
+/// One 10-bit symbol: start bit 0, the data bits LSB first, stop bit 1.
+static void symbol_put(struct symbol_writer *w, uint8_t symbol)
+{
+    symbol_writer_bits(w, (uint32_t)bit_reverse[symbol] << 1 | 1, 10);
+}
+
+/// One message byte as two Manchester symbols, added to the checksum.
+static void manchester_put(struct symbol_writer *w, uint8_t byte, uint8_t *sum)
+{
+    *sum += byte;
+    symbol_put(w, manchester_encode_lut[byte >> 4]);
+    symbol_put(w, manchester_encode_lut[byte & 0x0F]);
+}
+
+// Encoder, the exact inverse of messageDecode(): preamble and sync word for
+// the receiving CC1101, the 17 bit preamble pattern, the 0x33 0x55 0x53
+// header, the Manchester encoded message (with its checksum computed here)
+// and the 0x35 0x55 trailer, padded with alternating bits. Bytes the decoder
+// left unparsed after the payload are sent back in place.
+// Returns the packet length, or 0 if the message does not fit.
+uint8_t RAMSES::messageEncode(const RAMSESMessage *msg, CC1101Packet *packet) {
+  struct symbol_writer w = { packet->data, 0, sizeof(packet->data), 0, 0, false };
+  uint8_t sum = 0;
+
+  if (msg->num_device_ids > RAMSES_MAX_DEVICE_IDS
+      || msg->payload_offset + msg->payload_length > sizeof(msg->frame)
+      || msg->unparsed_offset + msg->unparsed_length > sizeof(msg->frame))
+    return 0;
+
+  // preamble and the SYNC1/SYNC0 sync word, sent as data (no sync in the send profile)
+  for (unsigned i = 0; i < 6; i++)
+    symbol_writer_bits(&w, 0xAA, 8);
+  symbol_writer_bits(&w, SYNC1, 8);
+  symbol_writer_bits(&w, SYNC0, 8);
+
+  // 17 bit preamble pattern FE 00 80, see messageDecodeReference()
+  symbol_writer_bits(&w, 0xFE00, 16);
+  symbol_writer_bits(&w, 1, 1);
+
+  // Manchester breaking header
+  symbol_put(&w, 0x33);
+  symbol_put(&w, 0x55);
+  symbol_put(&w, 0x53);
+
+  // fields straight from the message, no copy of the bytes
+  manchester_put(&w, msg->header, &sum);
+  for (unsigned i = 0; i < msg->num_device_ids; i++)
+    for (unsigned j = 0; j < 3; j++)
+      manchester_put(&w, msg->device_id[i][j], &sum);
+  manchester_put(&w, msg->command >> 8, &sum);
+  manchester_put(&w, msg->command & 0xFF, &sum);
+  manchester_put(&w, msg->payload_length, &sum);
+  for (unsigned i = 0; i < msg->payload_length; i++)
+    manchester_put(&w, msg->payload()[i], &sum);
+  for (unsigned i = 0; i < msg->unparsed_length; i++)
+    manchester_put(&w, msg->unparsed()[i], &sum);
+
+  // checksum: all bytes add up to 0
+  manchester_put(&w, -sum, &sum);
+
+  // footer, then a 1 where the next start bit would be so decoding ends here
+  symbol_put(&w, 0x35);
+  symbol_put(&w, 0x55);
+  do {
+    symbol_writer_bits(&w, 1, 1);
+    if (w.bits)
+      symbol_writer_bits(&w, 0, 1);
+  } while (w.bits);
+  symbol_writer_bits(&w, 0xAA, 8);
+
+  if (w.overflow)
+    return 0;
+  return w.len;
+}
+
 uint8_t RAMSES::ReadRSSI()
 {
   uint8_t rssi = 0;
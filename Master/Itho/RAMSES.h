@@ -5,16 +5,150 @@
 #ifndef __ITHOCC1101_H__
 #define __ITHOCC1101_H__
 
+#if defined(__AVR__)
+#error "RAMSES needs <atomic> and ~6 KB of static RAM, see the budget in the class: ESP8266/ESP32 only"
+#endif
+
 #include <stdio.h>
+#include <atomic>
 #include "CC1101.h"
 #include "RAMSESMessage.h"
+#include "bitbuffer.h"
+#include "SpscRing.h"
+#include "SeqlockSnapshot.h"
+#include "RAMSESDeviceRegistry.h"
+#include "RAMSESEvents.h"
+#include "RAMSESLog.h"
+#include "RAMSESLatency.h"
+#include "RAMSESStats.h"
+#include "RAMSESCapture.h"
+
+//with the GDO2 interrupt enabled, still poll the radio this often in case an edge was missed
+#define RAMSES_IRQ_FALLBACK_MS 1000
+
+//the synthesizer is calibrated once and the result reused for RX and TX; redo it this often for temperature drift
+#define RAMSES_RECALIBRATE_MS 300000
+
+//raw frames buffered between receivePacket() and processPacket(), must be a power of two
+#ifndef RAMSES_RX_RING_SIZE
+#define RAMSES_RX_RING_SIZE 8
+#endif
+
+//retransmissions of a frame within this many ms are dropped before messageInterpret()
+#ifndef RAMSES_DEDUP_WINDOW_MS
+#define RAMSES_DEDUP_WINDOW_MS 500
+#endif
+
+//frames remembered for that
+#ifndef RAMSES_DEDUP_SIZE
+#define RAMSES_DEDUP_SIZE 8
+#endif
+
+//RAMSESSubscribers that can be registered at once
+#ifndef RAMSES_MAX_SUBSCRIBERS
+#define RAMSES_MAX_SUBSCRIBERS 4
+#endif
+
+//encoded command frames kept for resending
+#ifndef RAMSES_TX_CACHE_SIZE
+#define RAMSES_TX_CACHE_SIZE 4
+#endif
+
+//devices tracked by source ID, must be a power of two
+#ifndef RAMSES_DEVICE_REGISTRY_SIZE
+#define RAMSES_DEVICE_REGISTRY_SIZE 32
+#endif
+
+typedef RAMSESDeviceRegistry<RAMSES_DEVICE_REGISTRY_SIZE> RAMSESDevices;
+
+//decodes a frame chunk by chunk as it is read from the RX fifo
+class RAMSESStreamDecoder
+{
+  public:
+    RAMSESStreamDecoder() { reset(); }
+    void reset();
+    int feed(const uint8_t *data, uint8_t count);   //0: more needed, > 0: complete (message bytes), < 0: rejected
+    uint16_t frameLength() const { return length; } //bytes from the sync word through the trailer, 0 until the payload length is in
+    const uint8_t *message() const { return bytes; }
+    uint8_t messageLength() const { return numBytes; }
+    uint8_t rejectReason() const { return reason; }  //RAMSES_STAT_* of a rejected frame, RAMSES_STATS otherwise
+
+  private:
+    void symbol(uint8_t value);
+    int finish(int code);
+    int reject(int code, uint8_t stat);
+
+    uint8_t state;
+    int result;
+    uint8_t reason;
+    uint32_t acc;                   //bits not decoded yet, right aligned
+    uint8_t bits;
+    uint8_t symbols;                //header symbols seen
+    uint8_t high;
+    bool haveHigh;
+    uint8_t numBytes;
+    uint8_t lengthIndex;            //message byte holding the payload length
+    uint8_t sum;
+    uint16_t expected;              //message bytes, checksum included, 0 until the payload length is in
+    uint16_t length;
+    uint8_t bytes[RAMSES_MESSAGE_MAX];
+};
+
+//frame as read from the RX fifo, queued for the decoder
+struct RAMSESRawFrame {
+  CC1101Packet packet;
+  uint32_t timestamp;   //micros() when the frame was read
+  uint32_t ticks;       //ramsesSharedTicks() then, for the latency of the stages after it
+  uint8_t rssi;         //CC1101 RSSI register, raw
+  uint8_t lqi;          //CC1101 LQI register, raw
+  uint8_t message[RAMSES_MESSAGE_MAX];  //Manchester decoded and checked while it came in
+  uint8_t messageLength;
+};
+
+
+//commands that can be sent as a remote
+enum IthoCommand
+{
+  IthoUnknown = 0,
+  IthoJoin,
+  IthoLeave,
+  IthoStandby,
+  IthoLow,
+  IthoMedium,
+  IthoHigh,
+  IthoFull,
+  IthoTimer1,
+  IthoTimer2,
+  IthoTimer3
+};
+
+//last message processPacket() accepted, as published to readers
+struct RAMSESLastMessage {
+  RAMSESMessage message;
+  IthoCommand command;  //what a remote meant by it, IthoUnknown if no command table matches
+  uint32_t timestamp;   //micros() when the frame was read
+  uint8_t rssi;         //CC1101 RSSI register, raw
+};
+//recently seen frame, by hash of all its message bytes
+struct RAMSESDedupEntry {
+  bool used;
+  uint32_t hash;
+  uint32_t timestamp;   //micros() when its last copy was read
+};
 
+//encoded frame of a command, keyed by command and addresses
+struct RAMSESTxCacheEntry {
+  uint8_t command;      //IthoCommand
+  uint8_t source[3];
+  uint8_t destination[3];
+  CC1101Packet packet;  //length 0: unused
+};
 
 //pa table settings
 const uint8_t ithoPaTableSend[8] = {0x6F, 0x26, 0x2E, 0x8C, 0x87, 0xCD, 0xC7, 0xC0};
 const uint8_t ithoPaTableReceive[8] = {0x6F, 0x26, 0x2E, 0x7F, 0x8A, 0x84, 0xCA, 0xC4};
 
-//message command bytes
+//message command bytes: opcode (2), payload length, first 3 payload bytes
 const uint8_t ithoMessageRVHighCommandBytes[] =   {49,224,4,0,0,200};
 const uint8_t ithoMessageHighCommandBytes[] =     {34,241,3,0,4,4};
 const uint8_t ithoMessageFullCommandBytes[] =     {34,241,3,0,4,4};
@@ -55,53 +189,201 @@ class RAMSES : protected CC1101
     void initReceive();
     // uint8_t getLastCounter() { return outMessage.counter; }        //counter is increased before sending a command
     void setSendTries(uint8_t sendTries) { this->sendTries = sendTries; }
-    // void setDeviceID(uint8_t byte0, uint8_t byte1, uint8_t byte2) { this->outMessage.deviceId[0] = byte0; this->outMessage.deviceId[1] = byte1; this->outMessage.deviceId[2] = byte2;}
+    void setDeviceID(uint8_t byte0, uint8_t byte1, uint8_t byte2) { setDeviceID(byte0, byte1, byte2, byte0, byte1, byte2); }   //remotes address themselves
+    void setDeviceID(uint8_t byte0, uint8_t byte1, uint8_t byte2, uint8_t dest0, uint8_t dest1, uint8_t dest2) {
+      uint8_t *source = outMessage.device_id[0], *destination = outMessage.device_id[1];
+      source[0] = byte0; source[1] = byte1; source[2] = byte2;
+      destination[0] = dest0; destination[1] = dest1; destination[2] = dest2;
+    }
+
+    // stack per call, deepest path (gcc -fstack-usage, host build; 32-bit targets need no more):
+    //   receivePacket() ~110 bytes, frames go straight into the ring; ~370 with a recorder (recordFrame(), PackBits)
+    //   processPacket() ~110 bytes, it parses into the snapshot slot; ~210 through messageInterpret(), plus the subscribers
+    //   sendCommand()   ~250 bytes, through commandPacket() and messageEncode(); packets live in the cache
+    // static RAM, sizeof(RAMSES) ~6.2 KB with the defaults (host build, 64-bit pointers), mostly:
+    //   rxRing         ~1.5 KB, RAMSES_RX_RING_SIZE frames of ~190 bytes
+    //   latency        ~1.1 KB, RAMSES_STAGES histograms
+    //   stats          ~0.85 KB, counters and RAMSES_STATS_MINUTES snapshots
+    //   logRing        ~0.65 KB, RAMSES_LOG_RING_SIZE records; none with RAMSES_LOG_LEVEL 0
+    //   devices        ~0.65 KB, RAMSES_DEVICE_REGISTRY_SIZE entries
+    //   txCache        ~0.55 KB, RAMSES_TX_CACHE_SIZE packets
+    // a RAMSESRecorder adds RAMSES_CAPTURE_BUFFER; far more than small AVRs have (2 KB on an ATmega328P)
 
     // receiving
-    bool checkForNewPacket();                       //check RX fifo for new data
-    // RAMSESMessage getLastMessage() const { return inMessage; }           //retrieve last received/parsed packet from remote
-    // IthoCommand getLastCommand() const { return inMessage.command; }           //retrieve last received/parsed command from remote
+    bool checkForNewPacket();                       //check RX fifo for new data (only if signalled, when the interrupt is enabled)
+    bool receivePacket();                           //radio side of checkForNewPacket(): move a frame from the RX fifo to the ring
+    bool processPacket();                           //decoder side of checkForNewPacket(): decode and interpret the oldest frame in the ring
+    void enableInterrupt(uint8_t pin);              //GDO2 (end of packet) is wired to pin, receive on its falling edge
+    void disableInterrupt();                        //back to polling the RX fifo on every checkForNewPacket()
+    bool packetPending() const { return packetIrq.load(); }   //GDO2 signalled a packet, no SPI involved
+    bool waitForPacket(unsigned long timeout);      //yield until GDO2 signals a packet or timeout (ms) expires
+    uint32_t getPacketsReceived() const { return packetsReceived; }
+    uint32_t getFramesDropped() const { return stats.get(RAMSES_STAT_RING_FULL); }   //frames read while the ring was full
+    uint16_t getRingHighWater() const { return ringHighWater.load(std::memory_order_relaxed); }
+    uint32_t getFramesBackToBack() const { return framesBackToBack; }     //frames that were in the FIFO behind another one, lost to a flush before
+    void setDedupWindow(uint16_t ms) { dedupWindow = ms; }                //0: every copy of a retransmitted frame is processed
+    uint32_t getFramesUnique() const { return framesUnique; }
+    uint32_t getFramesDuplicate() const { return framesDuplicate; }       //retransmissions suppressed
+    bool subscribe(RAMSESSubscriber *subscriber);   //events of accepted messages, in processPacket()'s context; false when full
+    void unsubscribe(RAMSESSubscriber *subscriber); //both before processPacket() runs elsewhere, the list is not locked
+    const RAMSESDevices &getDevices() const { return devices; }           //every source ID heard, see RAMSESDeviceRegistry::forEach()
+    using CC1101::getSpiTransactions;
+
+    // last accepted message, safe to read from any task or core while processPacket() runs
+    const SeqlockSnapshot<RAMSESLastMessage> &getLastSnapshot() const { return lastMessage; }  //zero-copy: read(), use, valid()
+    bool getLastMessage(RAMSESMessage *msg) const;  //consistent copy, false if nothing was received yet
+    IthoCommand getLastCommand() const;             //retrieve last received/parsed command from remote
+    uint32_t getLastID() const;                     //packed source ID, RAMSES_DEVICE_NONE if nothing was received yet
+    int LastMessageDecoded(char *buf, size_t size) const;   //one line summary, snprintf() style
     // uint8_t getLastInCounter() const { return inMessage.counter; }           //retrieve last received/parsed command from remote
-    // int * getLastID() const;
     // String getLastIDstr(bool ashex=true) const;
     // CC1101Packet getLastPacket() const;
-    // String LastMessageDecoded() const;
 
     // sending
-    // void sendCommand(IthoCommand command);
+    void sendCommand(IthoCommand command);         //send as a remote, sendTries times; IthoUnknown and IthoStandby are not sent
+    void sendPacket(CC1101Packet *packet);          //transmit, then back to receive
+    void setFastTurnaround(bool fast) { fastTurnaround = fast; }  //false: reset and reconfigure the chip around every transmission
+    uint32_t getTurnaroundRxTx() const { return turnaroundRxTx; } //us from leaving RX until TX can start, last transmission
+    uint32_t getTurnaroundTxRx() const { return turnaroundTxRx; } //us from the end of TX until back in RX, last transmission
+    uint32_t getTxCacheHits() const { return txCacheHits; }       //sendCommand() frames taken from the cache
+    uint32_t getTxCacheMisses() const { return txCacheMisses; }   //sendCommand() frames that had to be encoded
+
+    // deferred log of the receive and decode path, see RAMSESLog.h; drain it where printing cannot hold up reception
+#if RAMSES_LOG_LEVEL > RAMSES_LOG_NONE
+    void setLogLevel(uint8_t level) { logRing.setLevel(level); }       //RAMSES_LOG_*, records above it are not made
+    bool readLog(RAMSESLogRecord *record) { return logRing.read(record); }   //oldest record, false when there is none
+    unsigned printLog(unsigned max = RAMSES_LOG_RING_SIZE);           //format up to max records to Serial, returns how many
+    uint32_t getLogDropped() const { return logRing.getDropped(); }   //records lost to a full ring
+#else
+    void setLogLevel(uint8_t) {}
+    bool readLog(RAMSESLogRecord *) { return false; }
+    unsigned printLog(unsigned = 0) { return 0; }
+    uint32_t getLogDropped() const { return 0; }
+#endif
+
+    // time spent per stage of the receive pipeline, see RAMSESLatency.h
+    RAMSESLatencySummary getLatency(uint8_t stage) const { return latency[stage].summary(); }   //RAMSES_STAGE_*, in ticks
+    const RAMSESHistogram &getLatencyHistogram(uint8_t stage) const { return latency[stage]; }
+    void resetLatency();
+    void printLatency();                            //count, min, p50, p99 and max of every stage in us, to Serial
+
+    // receive quality, see RAMSESStats.h
+    const RAMSESStats &getStats() const { return stats; }
+    void printStats();                              //every counter with its 1 and 15 minute rate, to Serial
+
+    // capture of every frame read from the RX fifo, rejected ones included, see RAMSESCapture.h
+    bool setRecorder(RAMSESRecorder *recorder);     //starts the capture with its header, NULL stops it; before receivePacket() runs elsewhere
 
     // other
     uint8_t ReadRSSI();
 
+    // decoding (single pass), and the multi-stage reference it is checked against;
+    // the reference needs ~800 bytes of stack for its bitbuffers, keep it off small targets
+    int messageDecode(const CC1101Packet *packet, RAMSESMessage *msg);
+    int messageDecodeReference(const CC1101Packet *packet, bitbuffer_t *bits);    //Manchester decoded message bytes into bits
+    int messageParseReference(const bitbuffer_t *bits, RAMSESMessage *msg);
+    int messageParse(const uint8_t *bytes, uint8_t length, RAMSESMessage *msg);    //fields of decoded message bytes
+
+    // encoding, the inverse of messageDecode(): returns the packet length, 0 if it does not fit
+    uint8_t messageEncode(const RAMSESMessage *msg, CC1101Packet *packet);
+
   private:
     RAMSES( const RAMSES &c);
     RAMSES& operator=( const RAMSES &c);
 
     //init CC1101 for receiving
     void initReceiveMessage();
+    void enterReceive();
+
+    //synthesizer calibration, cached so mode switches need not repeat it
+    void calibrate();
+    void loadRadioProfile(const CC1101Profile &profile, uint8_t length);
+    void switchRadioProfile(const CC1101Profile &from, const CC1101Profile &to, uint8_t length);
+    bool calibrated;
+    uint8_t fscal[3];               //FSCAL3, FSCAL2, FSCAL1
+    unsigned long lastCalibration;
+    bool fastTurnaround;
+    uint32_t turnaroundRxTx;
+    uint32_t turnaroundTxRx;
+
+    //GDO2 end of packet interrupt
+    static void packetInterrupt();
+    static RAMSES *interruptInstance;
+    std::atomic<bool> packetIrq;
+    std::atomic<uint32_t> irqTicks;                 //ramsesSharedTicks() at the last edge
+    int16_t irqPin;
+    unsigned long lastPoll;
+    uint32_t packetsReceived;
+
+    //frame being read from the RX fifo, its length once the header is in
+    void restartReceive();
+    void continueReceive();
+    RAMSESRawFrame *rxFrame;
+    RAMSESRawFrame rxScratch;       //read into this when the ring is full, then dropped
+    uint8_t rxLength;
+    bool rxResync;                  //length known too late to end the packet there, flush after the frame
+    bool rxKept;                    //the next frame was already coming in when the last one was complete
+    uint32_t framesBackToBack;
+    RAMSESStreamDecoder rxDecoder;
+
+    //each written by the side its stage runs on
+    RAMSESHistogram latency[RAMSES_STAGES];
+
+    //bumped by both sides, snapshots taken by receivePacket()
+    RAMSESStats stats;
+
+    //the frame being read, as it stands, to the recorder; adds FREQEST, and RSSI/LQI when they were not read yet
+    void recordFrame(uint8_t stat);
+    RAMSESRecorder *recorder;
+
+    //raw frames from receivePacket() to processPacket(), which may run on another core/thread
+    SpscRing<RAMSESRawFrame, RAMSES_RX_RING_SIZE> rxRing;
+    std::atomic<uint16_t> ringHighWater;            //written by receivePacket() only, read from anywhere
+
+#if RAMSES_LOG_LEVEL > RAMSES_LOG_NONE
+    RAMSESLogRing<RAMSES_LOG_RING_SIZE> logRing;   //written by both sides, drained by printLog()/readLog()
+#endif
 
     //init CC1101 for sending
     void initSendMessage(uint8_t len);
     void finishTransfer();
 
-    //parse received message
-    int messageParse(RAMSESMessage *msg);
-    int messageInterpret(const RAMSESMessage *msg);
+    //interpret received message, for the subscribers
+    int messageInterpret(const RAMSESMessage *msg, uint32_t timestamp, uint8_t rssi);
+    RAMSESSubscriber *subscribers[RAMSES_MAX_SUBSCRIBERS];
+    uint8_t numSubscribers;
+
+    //retransmissions, only touched by processPacket()
+    static uint32_t frameHash(const uint8_t *bytes, uint8_t length);
+    bool isDuplicate(uint32_t hash, uint32_t timestamp);
+    RAMSESDedupEntry dedupCache[RAMSES_DEDUP_SIZE];
+    uint16_t dedupWindow;
+    uint32_t framesUnique;
+    uint32_t framesDuplicate;
+
+    //written by processPacket() only, see getLastSnapshot()
+    SeqlockSnapshot<RAMSESLastMessage> lastMessage;
+    IthoCommand messageCommand(const RAMSESMessage *msg);
+
+    //devices heard, only touched by processPacket()
+    RAMSESDevice *trackDevice(const RAMSESMessage *msg, uint8_t rssi, uint8_t lqi);   //NULL: no source ID, or the table is full
+    RAMSESDevices devices;
     // bool checkIthoCommand(RAMSESMessage *itho, const uint8_t commandBytes[]);
 
     // sending
-    void createMessageStart(RAMSESMessage *itho, CC1101Packet *packet);
-    void createMessageCommand(RAMSESMessage *itho, CC1101Packet *packet);
+    void createMessageStart(RAMSESMessage *itho, const uint8_t commandBytes[]);
+    void createMessageCommand(RAMSESMessage *itho, CC1101Packet *packet, IthoCommand command);
     void createMessageJoin(RAMSESMessage *itho, CC1101Packet *packet);
     void createMessageLeave(RAMSESMessage *itho, CC1101Packet *packet);
-    // uint8_t* getMessageCommandBytes(IthoCommand command);
-    uint8_t getCounter2(RAMSESMessage *itho, uint8_t len);
-
-    uint8_t messageEncode(const RAMSESMessage *itho, CC1101Packet *packet);
-    int messageDecode(const CC1101Packet *packet, RAMSESMessage *itho);
+    const uint8_t *getMessageCommandBytes(IthoCommand command);
+    CC1101Packet *commandPacket(IthoCommand command);
 
     //send
     RAMSESMessage outMessage;                       //stores state of "remote"
+    RAMSESTxCacheEntry txCache[RAMSES_TX_CACHE_SIZE];
+    uint8_t txCacheNext;                            //slot replaced on the next miss
+    uint32_t txCacheHits;
+    uint32_t txCacheMisses;
 
     //settings
     uint8_t sendTries;                            //number of times a command is send at one button press
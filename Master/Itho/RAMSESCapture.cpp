@@ -0,0 +1,177 @@
+/*
+ * PackBits for capture records, and RAMSESRecorder's byte ring: record()
+ * encodes on the receive path, drain() writes out from wherever blocking is
+ * harmless. The format is described in RAMSESCapture.h.
+ */
+
+#include "RAMSESCapture.h"
+#include <string.h>
+
+size_t ramsesPackBits(const uint8_t *in, size_t length, uint8_t *out, size_t max) {
+  size_t i = 0, n = 0;
+
+  while (i < length) {
+    // a run of 3 to 128 equal bytes: header 1 - run, then the byte
+    size_t run = 1;
+    while (i + run < length && run < 128 && in[i + run] == in[i])
+      run++;
+    if (run >= 3) {
+      if (n + 2 > max)
+        return 0;
+      out[n++] = (uint8_t)(257 - run);
+      out[n++] = in[i];
+      i += run;
+      continue;
+    }
+
+    // up to 128 literal bytes, until the next run: header count - 1, then the bytes
+    size_t start = i;
+    while (i < length && i - start < 128 && !(i + 2 < length && in[i] == in[i + 1] && in[i] == in[i + 2]))
+      i++;
+    size_t count = i - start;
+    if (n + 1 + count > max)
+      return 0;
+    out[n++] = (uint8_t)(count - 1);
+    memcpy(&out[n], &in[start], count);
+    n += count;
+  }
+  return n;
+}
+
+size_t ramsesUnpackBits(const uint8_t *in, size_t length, uint8_t *out, size_t count) {
+  size_t i = 0, n = 0;
+
+  while (n < count) {
+    if (i >= length)
+      return 0;
+    uint8_t header = in[i++];
+    if (header < 128) {
+      size_t literal = header + 1;
+      if (i + literal > length || n + literal > count)
+        return 0;
+      memcpy(&out[n], &in[i], literal);
+      i += literal;
+      n += literal;
+    }
+    else if (header > 128) {
+      size_t run = 257 - header;
+      if (i >= length || n + run > count)
+        return 0;
+      memset(&out[n], in[i++], run);
+      n += run;
+    }
+  }
+  return i;
+}
+
+uint8_t ramsesCaptureReason(uint8_t stat) {
+  switch (stat) {
+    case RAMSES_STATS:              return RAMSES_CAPTURE_ACCEPTED;
+    case RAMSES_STAT_FIFO_OVERFLOW: return RAMSES_CAPTURE_FIFO_OVERFLOW;
+    case RAMSES_STAT_RING_FULL:     return RAMSES_CAPTURE_RING_FULL;
+    case RAMSES_STAT_LENGTH:        return RAMSES_CAPTURE_LENGTH;
+    case RAMSES_STAT_MIC:           return RAMSES_CAPTURE_MIC;
+    case RAMSES_STAT_SANITY:        return RAMSES_CAPTURE_SANITY;
+    case RAMSES_STAT_PREAMBLE:      return RAMSES_CAPTURE_PREAMBLE;
+    case RAMSES_STAT_HEADER:        return RAMSES_CAPTURE_HEADER;
+    case RAMSES_STAT_MANCHESTER:    return RAMSES_CAPTURE_MANCHESTER;
+    case RAMSES_STAT_TRAILER:       return RAMSES_CAPTURE_TRAILER;
+    default:                        return RAMSES_CAPTURE_OTHER;
+  }
+}
+
+bool ramsesCaptureExpand(const RAMSESCaptureRecord *record, uint8_t *out, size_t max) {
+  const uint8_t *bytes = (const uint8_t *)(record + 1);
+
+  if (record->size < RAMSES_CAPTURE_RECORD_SIZE(0) || record->length > max)
+    return false;
+  size_t stored = record->size - sizeof(RAMSESCaptureRecord);
+  if (record->flags & RAMSES_CAPTURE_PACKBITS)
+    return ramsesUnpackBits(bytes, stored, out, record->length) != 0;
+  if (record->length > stored)
+    return false;
+  memcpy(out, bytes, record->length);
+  return true;
+}
+
+bool RAMSESRecorder::begin(const uint8_t profile[CC1101_CONFIG_REGISTERS]) {
+  RAMSESCaptureHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, RAMSES_CAPTURE_MAGIC, sizeof(header.magic));
+  header.version = RAMSES_CAPTURE_VERSION;
+  header.headerSize = sizeof(header);
+  memcpy(header.profile, profile, sizeof(header.profile));
+  lastMicros = 0;
+  epoch = 0;
+  return put((const uint8_t *)&header, sizeof(header));
+}
+
+bool RAMSESRecorder::record(const CC1101Packet *packet, uint32_t timestamp, uint8_t rssi, uint8_t lqi, uint8_t freqest, uint8_t stat) {
+  static const uint8_t padding[8] = { 0 };
+  // compressed only when that is shorter
+  uint8_t length = packet->length;
+  size_t packed = ramsesPackBits(packet->data, length, scratch, length ? length - 1 : 0);
+  const uint8_t *bytes = packed ? scratch : packet->data;
+  size_t count = packed ? packed : length;
+
+  if (timestamp < lastMicros)
+    epoch++;
+  lastMicros = timestamp;
+
+  RAMSESCaptureRecord r;
+  r.timestamp = (uint64_t)epoch << 32 | timestamp;
+  r.size = RAMSES_CAPTURE_RECORD_SIZE(count);
+  r.length = length;
+  r.flags = packed ? RAMSES_CAPTURE_PACKBITS : 0;
+  r.rssi = rssi;
+  r.lqi = lqi;
+  r.freqest = freqest;
+  r.reason = ramsesCaptureReason(stat);
+
+  uint32_t h = head.load(std::memory_order_relaxed);
+  if (RAMSES_CAPTURE_BUFFER - (h - tail.load(std::memory_order_acquire)) < r.size) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  copyIn(h, (const uint8_t *)&r, sizeof(r));
+  copyIn(h + sizeof(r), bytes, count);
+  copyIn(h + sizeof(r) + count, padding, r.size - sizeof(r) - count);
+  head.store(h + r.size, std::memory_order_release);
+  recorded.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+size_t RAMSESRecorder::drain(size_t max) {
+  uint32_t t = tail.load(std::memory_order_relaxed);
+  size_t available = head.load(std::memory_order_acquire) - t;
+  size_t done = 0;
+
+  if (available > max)
+    available = max;
+  while (done < available) {
+    size_t at = (t + done) & (RAMSES_CAPTURE_BUFFER - 1);
+    size_t chunk = available - done < RAMSES_CAPTURE_BUFFER - at ? available - done : RAMSES_CAPTURE_BUFFER - at;
+    size_t written = out.write(&buffer[at], chunk);
+    done += written;
+    if (written < chunk)
+      break;
+  }
+  tail.store(t + done, std::memory_order_release);
+  return done;
+}
+
+bool RAMSESRecorder::put(const uint8_t *data, size_t length) {
+  uint32_t h = head.load(std::memory_order_relaxed);
+  if (RAMSES_CAPTURE_BUFFER - (h - tail.load(std::memory_order_acquire)) < length)
+    return false;
+  copyIn(h, data, length);
+  head.store(h + length, std::memory_order_release);
+  return true;
+}
+
+void RAMSESRecorder::copyIn(uint32_t at, const uint8_t *data, size_t length) {
+  size_t offset = at & (RAMSES_CAPTURE_BUFFER - 1);
+  size_t first = length < RAMSES_CAPTURE_BUFFER - offset ? length : RAMSES_CAPTURE_BUFFER - offset;
+  memcpy(&buffer[offset], data, first);
+  memcpy(buffer, data + first, length - first);
+}
@@ -0,0 +1,133 @@
+/*
+ * Binary capture of the raw frames read from the CC1101 RX FIFO.
+ *
+ * A capture is a RAMSESCaptureHeader (magic, version, the receive profile's
+ * register image) followed by records, each a fixed 16 byte
+ * RAMSESCaptureRecord and the packet bytes, padded to a multiple of 8. Every
+ * field has a fixed offset and is little-endian (as on every target), the
+ * header size and each record's size say where the next one starts, so a
+ * host tool can mmap() a capture and walk it by pointer without parsing.
+ * Packet bytes are PackBits run-length compressed when that is shorter: the
+ * zero and 0xAA runs behind the trailer of a fixed length recording, or of
+ * noise, shrink to two bytes.
+ *
+ * RAMSESRecorder is the library side: RAMSES::receivePacket() hands it every
+ * frame, accepted or not, and it encodes the record into a byte ring at once.
+ * The receive path never writes to the output; drain() copies the ring to a Print (Serial, a
+ * flash File) from wherever blocking is harmless, a low priority task or the
+ * end of loop(). Records that do not fit are counted and dropped whole, so a
+ * capture never has a torn record.
+ */
+
+#ifndef RAMSESCAPTURE_H_
+#define RAMSESCAPTURE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <Arduino.h>
+#include "CC1101.h"
+#include "CC1101Packet.h"
+#include "RAMSESStats.h"
+
+#define RAMSES_CAPTURE_MAGIC "RCAP"
+#define RAMSES_CAPTURE_VERSION 1
+
+//record flags
+#define RAMSES_CAPTURE_PACKBITS 0x01    //packet bytes are PackBits compressed
+
+//what the receiver did with a frame; part of the format, so not the RAMSESStat ordinals
+enum RAMSESCaptureReason {
+  RAMSES_CAPTURE_ACCEPTED = 0,      //queued for processPacket()
+  RAMSES_CAPTURE_FIFO_OVERFLOW = 1,
+  RAMSES_CAPTURE_RING_FULL = 2,     //complete, but the ring had no room
+  RAMSES_CAPTURE_LENGTH = 3,
+  RAMSES_CAPTURE_MIC = 4,
+  RAMSES_CAPTURE_SANITY = 5,
+  RAMSES_CAPTURE_PREAMBLE = 6,
+  RAMSES_CAPTURE_HEADER = 7,
+  RAMSES_CAPTURE_MANCHESTER = 8,
+  RAMSES_CAPTURE_TRAILER = 9,
+  RAMSES_CAPTURE_OTHER = 255
+};
+
+//bytes buffered until drained, must be a power of two
+#ifndef RAMSES_CAPTURE_BUFFER
+#define RAMSES_CAPTURE_BUFFER 1024
+#endif
+
+struct RAMSESCaptureHeader {
+  char magic[4];                //RAMSES_CAPTURE_MAGIC
+  uint16_t version;             //RAMSES_CAPTURE_VERSION
+  uint16_t headerSize;          //the first record starts here
+  uint8_t profile[CC1101_CONFIG_REGISTERS];   //registers 0x00-0x2E as the receiver loads them
+  uint8_t reserved;
+};
+
+struct RAMSESCaptureRecord {
+  uint64_t timestamp;           //us, micros() extended past its wrap
+  uint16_t size;                //this header, the bytes and the padding: the next record starts there
+  uint8_t length;               //packet bytes, expanded
+  uint8_t flags;                //RAMSES_CAPTURE_*
+  uint8_t rssi;                 //CC1101 RSSI register, raw
+  uint8_t lqi;                  //CC1101 LQI register, raw
+  uint8_t freqest;              //CC1101 FREQEST register, raw (two's complement)
+  uint8_t reason;               //RAMSES_CAPTURE_*
+};
+
+static_assert(sizeof(RAMSESCaptureHeader) % 8 == 0, "records have to stay 8 byte aligned");
+static_assert(sizeof(RAMSESCaptureRecord) == 16, "the record header is part of the capture format");
+
+//record size for packet bytes that take length in the capture
+#define RAMSES_CAPTURE_RECORD_SIZE(length) ((sizeof(RAMSESCaptureRecord) + (length) + 7) & ~7u)
+
+//largest record, a packet that does not compress (PackBits adds a byte per 128)
+#define RAMSES_CAPTURE_RECORD_MAX RAMSES_CAPTURE_RECORD_SIZE(sizeof(((CC1101Packet *)0)->data) + 1)
+
+//PackBits: returns the bytes written to out, 0 if they do not fit in max
+size_t ramsesPackBits(const uint8_t *in, size_t length, uint8_t *out, size_t max);
+//the inverse, stopping after count bytes (the padding behind them is not data): returns the bytes of in used, 0 if it is malformed or short
+size_t ramsesUnpackBits(const uint8_t *in, size_t length, uint8_t *out, size_t count);
+
+//RAMSES_CAPTURE_* for a RAMSES_STAT_* reason, RAMSES_STATS meaning accepted
+uint8_t ramsesCaptureReason(uint8_t stat);
+
+//a record's packet bytes, expanded into out (at least length bytes); false if it is malformed
+bool ramsesCaptureExpand(const RAMSESCaptureRecord *record, uint8_t *out, size_t max);
+
+class RAMSESRecorder
+{
+  static_assert(RAMSES_CAPTURE_BUFFER >= RAMSES_CAPTURE_RECORD_MAX + sizeof(RAMSESCaptureHeader)
+                && (RAMSES_CAPTURE_BUFFER & (RAMSES_CAPTURE_BUFFER - 1)) == 0,
+                "RAMSES_CAPTURE_BUFFER must be a power of two that holds the header and a record");
+
+  public:
+    RAMSESRecorder(Print &out) : out(out), head(0), tail(0), recorded(0), dropped(0), lastMicros(0), epoch(0) {}
+
+    //producer side: starts a capture with its header; RAMSES::setRecorder() calls it
+    bool begin(const uint8_t profile[CC1101_CONFIG_REGISTERS]);
+    //producer side: one record, stat as for ramsesCaptureReason(); false if it was dropped because the buffer is full
+    bool record(const CC1101Packet *packet, uint32_t timestamp, uint8_t rssi, uint8_t lqi, uint8_t freqest, uint8_t stat);
+
+    //consumer side: write up to max buffered bytes to out, returns how many
+    size_t drain(size_t max = RAMSES_CAPTURE_BUFFER);
+
+    uint32_t getRecorded() const { return recorded.load(std::memory_order_relaxed); }
+    uint32_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+  private:
+    bool put(const uint8_t *data, size_t length);
+    void copyIn(uint32_t at, const uint8_t *data, size_t length);
+
+    Print &out;
+    uint8_t buffer[RAMSES_CAPTURE_BUFFER];
+    std::atomic<uint32_t> head;     //producer only writes it
+    std::atomic<uint32_t> tail;     //consumer only writes it
+    std::atomic<uint32_t> recorded;
+    std::atomic<uint32_t> dropped;
+    uint32_t lastMicros;            //producer only: micros() wraps every 71 minutes
+    uint32_t epoch;
+    uint8_t scratch[sizeof(((CC1101Packet *)0)->data)];   //producer only: PackBits output
+};
+
+#endif /* RAMSESCAPTURE_H_ */
@@ -0,0 +1,110 @@
+/*
+ * Fixed-capacity table of the devices heard, keyed by their 3 byte ID.
+ *
+ * Open addressing with linear probing over a power-of-two array, the ID
+ * packed into 24 bits and spread with a multiplicative hash, so a lookup is a
+ * multiply and, at the load a single home sees, one or two probes. There is
+ * no heap and no deletion: when every slot is taken, devices not in the table
+ * yet are counted as untracked instead. Written by one side only (the
+ * decoder); readers on another core may see an entry in the middle of an
+ * update.
+ */
+
+#ifndef RAMSESDEVICEREGISTRY_H_
+#define RAMSESDEVICEREGISTRY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RAMSES_DEVICE_NONE				0xFFFFFFFFUL	// free slot, no 24-bit ID has it
+#define RAMSES_FAN_SETTING_NONE			0xFF
+
+struct RAMSESDevice
+{
+	uint32_t id;				// packed ID, RAMSES_DEVICE_NONE for a free slot
+	uint32_t lastSeen;			// millis() of the last frame
+	uint32_t frames;
+	uint32_t errors;			// frames that parsed but could not be interpreted
+	uint8_t rssi;				// CC1101 RSSI register, raw, of the last frame
+	uint8_t lqi;				// CC1101 LQI register, raw, of the last frame
+	uint8_t fanSetting;			// 22F1 mode byte last sent, RAMSES_FAN_SETTING_NONE if none
+
+	uint8_t type() const { return id >> 18; }			// device class, the "tt" of tt:nnnnnn
+	uint32_t number() const { return id & 0x3FFFF; }
+};
+
+template <uint16_t N>
+class RAMSESDeviceRegistry
+{
+	static_assert(N > 0 && (N & (N - 1)) == 0, "RAMSESDeviceRegistry capacity must be a power of two");
+
+	public:
+		RAMSESDeviceRegistry() : count(0), untracked(0)
+		{
+			for (uint16_t i = 0; i < N; i++)
+				slots[i].id = RAMSES_DEVICE_NONE;
+		}
+
+		static uint32_t packId(const uint8_t id[3])
+		{
+			return (uint32_t)id[0] << 16 | (uint32_t)id[1] << 8 | id[2];
+		}
+
+		// entry of the device, or NULL if it is not in the table
+		const RAMSESDevice *find(uint32_t id) const
+		{
+			for (uint16_t i = home(id), n = 0; n < N; i = (i + 1) & (N - 1), n++) {
+				if (slots[i].id == id)
+					return &slots[i];
+				if (slots[i].id == RAMSES_DEVICE_NONE)
+					return NULL;
+			}
+			return NULL;
+		}
+
+		// entry of the device, added with zeroed counters if new; NULL when the table is full
+		RAMSESDevice *update(uint32_t id)
+		{
+			for (uint16_t i = home(id), n = 0; n < N; i = (i + 1) & (N - 1), n++) {
+				RAMSESDevice *device = &slots[i];
+				if (device->id == id)
+					return device;
+				if (device->id == RAMSES_DEVICE_NONE) {
+					device->id = id;
+					device->lastSeen = 0;
+					device->frames = 0;
+					device->errors = 0;
+					device->rssi = 0;
+					device->lqi = 0;
+					device->fanSetting = RAMSES_FAN_SETTING_NONE;
+					count++;
+					return device;
+				}
+			}
+			untracked++;
+			return NULL;
+		}
+
+		// call f(const RAMSESDevice &) for every device, in slot order
+		template <typename F>
+		void forEach(F f) const
+		{
+			for (uint16_t i = 0; i < N; i++)
+				if (slots[i].id != RAMSES_DEVICE_NONE)
+					f(slots[i]);
+		}
+
+		uint16_t size() const { return count; }
+		static uint16_t capacity() { return N; }
+		uint32_t getUntracked() const { return untracked; }	// frames from devices that found the table full
+
+	private:
+		// Fibonacci hashing, the upper half of the product is the well mixed part
+		static uint16_t home(uint32_t id) { return (uint32_t)(id * 2654435769UL) >> 16 & (N - 1); }
+
+		RAMSESDevice slots[N];
+		uint16_t count;
+		uint32_t untracked;
+};
+
+#endif /* RAMSESDEVICEREGISTRY_H_ */
@@ -0,0 +1,55 @@
+/*
+ * RAMSESEventPrinter: every subscriber event as text on Serial, in the
+ * format messageInterpret() printed before events existed.
+ */
+
+#include "RAMSESEvents.h"
+#include <Arduino.h>
+
+void RAMSESEventPrinter::printHeader(const RAMSESEvent &event) {
+  const RAMSESMessage *msg = event.message;
+
+  Serial.println("RAMSES::messageInterpret");
+  Serial.printf("- num_device_ids: %d\n", msg->num_device_ids);
+  for (unsigned i = 0; i < msg->num_device_ids; i++) {
+      Serial.printf("  %02x%02x%02x\n",
+                    msg->device_id[i][0],
+                    msg->device_id[i][1],
+                    msg->device_id[i][2]);
+  }
+  Serial.printf("- command: 0x%04x\n", msg->command);
+}
+
+void RAMSESEventPrinter::printSetting(const char *name, uint8_t setting) {
+  switch (setting) {
+  case FAN_AWAY:
+      Serial.printf("  %s: away\n", name);
+      break;
+  case FAN_AUTO:
+      Serial.printf("  %s: auto\n", name);
+      break;
+  default:
+      Serial.printf("  %s: %d\n", name, setting);
+  }
+}
+
+void RAMSESEventPrinter::onFanSetting(const RAMSESFanSettingCommand &event) {
+  printHeader(event);
+  printSetting("fan_setting", event.setting);
+}
+
+void RAMSESEventPrinter::onFanTimer(const RAMSESFanTimerCommand &event) {
+  printHeader(event);
+  Serial.printf("  fan_timer_minutes: %d\n", event.minutes);
+  printSetting("fan_setting", event.setting);
+  printSetting("fan_return_setting", event.returnSetting);
+}
+
+void RAMSESEventPrinter::onFanStatus(const RAMSESFanStatus &event) {
+  printHeader(event);
+  printSetting("fan_set_to", event.setting);
+}
+
+void RAMSESEventPrinter::onUnknown(const RAMSESUnknownMessage &event) {
+  printHeader(event);
+}
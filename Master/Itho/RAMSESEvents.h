@@ -0,0 +1,82 @@
+/*
+ * Typed events for the messages RAMSES::processPacket() accepts, delivered to
+ * RAMSESSubscriber callbacks by const reference. Nothing is allocated: an
+ * event lives on the decoder's stack and its payload pointers into the
+ * message, so both are only valid during the callback.
+ */
+
+#ifndef RAMSESEVENTS_H_
+#define RAMSESEVENTS_H_
+
+#include <stdint.h>
+#include "RAMSESMessage.h"
+#include "RAMSESDeviceRegistry.h"
+
+//fan setting bytes of 22F1, 22F3 and 31D9; 1 to 3 are the speeds
+enum fan_setting {
+  FAN_AWAY = 0,
+  FAN_1 = 1,
+  FAN_2 = 2,
+  FAN_3 = 3,
+  FAN_AUTO = 4
+};
+
+//what every event carries
+struct RAMSESEvent {
+  const RAMSESMessage *message;   //the whole message
+  uint32_t source;                //packed IDs, RAMSES_DEVICE_NONE if the header has none
+  uint32_t destination;
+  uint32_t timestamp;             //micros() when the frame was read
+  uint8_t rssi;                   //CC1101 RSSI register, raw
+};
+
+//22F1 from a remote: 00 <setting> 04
+struct RAMSESFanSettingCommand : RAMSESEvent {
+  uint8_t setting;                //fan_setting
+};
+
+//22F3 from a remote: 00 02 <minutes> <setting> <return setting> ..
+struct RAMSESFanTimerCommand : RAMSESEvent {
+  uint8_t minutes;
+  uint8_t setting;
+  uint8_t returnSetting;
+};
+
+//31D9 from the fan: .. .. <setting> ..
+struct RAMSESFanStatus : RAMSESEvent {
+  uint8_t setting;
+};
+
+//any other opcode
+struct RAMSESUnknownMessage : RAMSESEvent {
+  uint16_t opcode;
+  const uint8_t *payload;
+  uint8_t payloadLength;
+};
+
+//override what is of interest; called from processPacket(), keep it short
+class RAMSESSubscriber
+{
+  public:
+    virtual ~RAMSESSubscriber() {}
+    virtual void onFanSetting(const RAMSESFanSettingCommand &) {}
+    virtual void onFanTimer(const RAMSESFanTimerCommand &) {}
+    virtual void onFanStatus(const RAMSESFanStatus &) {}
+    virtual void onUnknown(const RAMSESUnknownMessage &) {}
+};
+
+//prints every event to Serial, as messageInterpret() used to
+class RAMSESEventPrinter : public RAMSESSubscriber
+{
+  public:
+    void onFanSetting(const RAMSESFanSettingCommand &event);
+    void onFanTimer(const RAMSESFanTimerCommand &event);
+    void onFanStatus(const RAMSESFanStatus &event);
+    void onUnknown(const RAMSESUnknownMessage &event);
+
+  private:
+    void printHeader(const RAMSESEvent &event);
+    void printSetting(const char *name, uint8_t setting);
+};
+
+#endif /* RAMSESEVENTS_H_ */
@@ -0,0 +1,156 @@
+/*
+ * Per-stage latency of the receive pipeline, in log2 histograms.
+ *
+ * A probe reads the cycle counter (ESP32/ESP8266 CCOUNT, steady_clock
+ * nanoseconds on the host, micros() elsewhere) before and after a stage and
+ * adds the difference to the stage's histogram: 32 buckets, bucket b counting
+ * durations in [2^(b-1), 2^b) ticks (the last one open ended), plus count,
+ * min and max. Recording is a count-leading-zeros and a few relaxed stores,
+ * cheap enough to stay on in production builds; RAMSES_LATENCY 0 compiles
+ * the probes out. Each histogram has a single writer (the side of RAMSES its
+ * stage runs on), readers may look from anywhere; p50/p99 are bucket upper
+ * bounds, clamped to min and max.
+ *
+ * CCOUNT is per core on the ESP32, and the radio and decoder sides of RAMSES
+ * may run on different cores. Stages that start on one side and end on the
+ * other (the interrupt, the ring, frame to event) are timed with
+ * RAMSES_PROBE_SHARED(), micros() there, at 1 us resolution but scaled to
+ * ticks like the rest.
+ */
+
+#ifndef RAMSESLATENCY_H_
+#define RAMSESLATENCY_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <Arduino.h>
+#if defined(ARDUINO_ARCH_HOST)
+#include <chrono>
+#endif
+
+#ifndef RAMSES_LATENCY
+#define RAMSES_LATENCY 1
+#endif
+
+#define RAMSES_LATENCY_BUCKETS 32
+
+#if defined(ARDUINO_ARCH_HOST)
+inline uint32_t ramsesTicks() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+inline uint32_t ramsesTicksPerUs() { return 1000; }
+#elif defined(ESP32) || defined(ESP8266)
+inline uint32_t ramsesTicks() { return ESP.getCycleCount(); }
+inline uint32_t ramsesTicksPerUs() { return ESP.getCpuFreqMHz(); }
+#else
+inline uint32_t ramsesTicks() { return micros(); }
+inline uint32_t ramsesTicksPerUs() { return 1; }
+#endif
+
+//a clock all cores agree on, and its ticks per ramsesTicks() tick
+#if defined(ESP32)
+inline uint32_t ramsesSharedTicks() { return micros(); }
+inline uint32_t ramsesSharedScale() { return ramsesTicksPerUs(); }
+#else
+inline uint32_t ramsesSharedTicks() { return ramsesTicks(); }
+inline uint32_t ramsesSharedScale() { return 1; }
+#endif
+
+enum RAMSESStage {
+  RAMSES_STAGE_IRQ,             //GDO2 interrupt until receivePacket() gets to it (shared clock)
+  RAMSES_STAGE_FIFO_READ,       //one RX FIFO burst read
+  RAMSES_STAGE_STREAM_DECODE,   //RAMSESStreamDecoder::feed() of that chunk
+  RAMSES_STAGE_RECEIVE,         //a receivePacket() call that reads from the FIFO, from deciding to read until it returns
+  RAMSES_STAGE_QUEUE,           //frame complete until processPacket() takes it from the ring (shared clock)
+  RAMSES_STAGE_PARSE,           //messageParse()
+  RAMSES_STAGE_INTERPRET,       //messageInterpret(), the subscribers included
+  RAMSES_STAGE_FRAME_TO_EVENT,  //frame complete until its events are delivered (shared clock)
+  RAMSES_STAGES
+};
+
+//ticks, see ramsesTicksPerUs()
+struct RAMSESLatencySummary {
+  uint32_t count;
+  uint32_t min;
+  uint32_t p50;
+  uint32_t p99;
+  uint32_t max;
+};
+
+class RAMSESHistogram
+{
+  public:
+    RAMSESHistogram() { reset(); }
+
+    //writer side
+    void record(uint32_t ticks) {
+      uint8_t b = bucketOf(ticks);
+      buckets[b].store(buckets[b].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      if (ticks < min.load(std::memory_order_relaxed))
+        min.store(ticks, std::memory_order_relaxed);
+      if (ticks > max.load(std::memory_order_relaxed))
+        max.store(ticks, std::memory_order_relaxed);
+      count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    //racing the writer loses at most the durations recorded meanwhile
+    void reset() {
+      for (uint8_t b = 0; b < RAMSES_LATENCY_BUCKETS; b++)
+        buckets[b].store(0, std::memory_order_relaxed);
+      min.store(UINT32_MAX, std::memory_order_relaxed);
+      max.store(0, std::memory_order_relaxed);
+      count.store(0, std::memory_order_release);
+    }
+
+    uint32_t getBucket(uint8_t b) const { return buckets[b].load(std::memory_order_relaxed); }
+    static uint32_t bucketLimit(uint8_t b) { return b == 0 ? 0 : b >= RAMSES_LATENCY_BUCKETS - 1 ? UINT32_MAX : (1UL << b) - 1; }
+
+    RAMSESLatencySummary summary() const {
+      RAMSESLatencySummary s;
+      s.count = count.load(std::memory_order_acquire);
+      s.min = s.count ? min.load(std::memory_order_relaxed) : 0;
+      s.max = max.load(std::memory_order_relaxed);
+      s.p50 = percentile(s, 50);
+      s.p99 = percentile(s, 99);
+      return s;
+    }
+
+  private:
+    static uint8_t bucketOf(uint32_t ticks) {
+      uint8_t b = ticks ? 32 - __builtin_clz(ticks) : 0;
+      return b < RAMSES_LATENCY_BUCKETS ? b : RAMSES_LATENCY_BUCKETS - 1;
+    }
+
+    uint32_t percentile(const RAMSESLatencySummary &s, uint8_t percent) const {
+      uint32_t rank = ((uint64_t)s.count * percent + 99) / 100, seen = 0;
+      for (uint8_t b = 0; b < RAMSES_LATENCY_BUCKETS && rank; b++) {
+        seen += getBucket(b);
+        if (seen >= rank) {
+          uint32_t limit = bucketLimit(b);
+          return limit < s.min ? s.min : limit > s.max ? s.max : limit;
+        }
+      }
+      return s.max;
+    }
+
+    std::atomic<uint32_t> buckets[RAMSES_LATENCY_BUCKETS];
+    std::atomic<uint32_t> count;
+    std::atomic<uint32_t> min;
+    std::atomic<uint32_t> max;
+};
+
+//uint32_t start = RAMSES_PROBE(); ... RAMSES_PROBE_END(histogram, start);
+//the _SHARED pair when start and end may be on different cores
+#if RAMSES_LATENCY
+#define RAMSES_PROBE() ramsesTicks()
+#define RAMSES_PROBE_END(histogram, start) (histogram).record(ramsesTicks() - (start))
+#define RAMSES_PROBE_SHARED() ramsesSharedTicks()
+#define RAMSES_PROBE_SHARED_END(histogram, start) (histogram).record((ramsesSharedTicks() - (start)) * ramsesSharedScale())
+#else
+#define RAMSES_PROBE() 0
+#define RAMSES_PROBE_END(histogram, start) ((void)(start))
+#define RAMSES_PROBE_SHARED() 0
+#define RAMSES_PROBE_SHARED_END(histogram, start) ((void)(start))
+#endif
+
+#endif /* RAMSESLATENCY_H_ */
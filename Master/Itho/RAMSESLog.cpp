@@ -0,0 +1,48 @@
+/*
+ * ramsesLogFormat(): a RAMSESLogRecord as one line of text, for whoever
+ * drains the log ring. The ring itself is header only, see RAMSESLog.h.
+ */
+
+#include "RAMSESLog.h"
+#include <stdio.h>
+
+int ramsesLogFormat(const RAMSESLogRecord *record, char *buf, size_t size) {
+  static const char levels[] = "-EWID";
+  static const char *const names[] = {
+    "parse error", "interpret error", "RX FIFO overflow", "stream decoder reject",
+    "ring full", "raw packet", "raw message"
+  };
+  const char *name = record->event < sizeof(names) / sizeof(names[0]) ? names[record->event] : "?";
+  char level = record->level < sizeof(levels) - 1 ? levels[record->level] : '?';
+  int n = 0, r;
+
+  switch (record->event) {
+    case RAMSES_LOG_INTERPRET_ERROR:
+      r = snprintf(buf, size, "%10lu %c %s: %ld, opcode %04lX from %02lu:%06lu", (unsigned long)record->timestamp, level, name,
+                   (long)record->args[0], (unsigned long)record->args[1],
+                   (unsigned long)record->args[2] >> 18, (unsigned long)record->args[2] & 0x3FFFF);
+      break;
+    case RAMSES_LOG_STREAM_REJECT:
+      r = snprintf(buf, size, "%10lu %c %s: %ld after %ld bytes, stat %ld", (unsigned long)record->timestamp, level, name,
+                   (long)record->args[0], (long)record->args[1], (long)record->args[2]);
+      break;
+    case RAMSES_LOG_RAW_PACKET:
+    case RAMSES_LOG_RAW_MESSAGE:
+      r = snprintf(buf, size, "%10lu %c %s: {%u}", (unsigned long)record->timestamp, level, name, 8 * record->length);
+      break;
+    default:
+      r = snprintf(buf, size, "%10lu %c %s: %ld %ld", (unsigned long)record->timestamp, level, name,
+                   (long)record->args[0], (long)record->args[1]);
+  }
+  n = r > 0 ? r : 0;
+
+  for (uint8_t i = 0; i < record->count; i++) {
+    r = snprintf(buf + ((size_t)n < size ? n : size), (size_t)n < size ? size - n : 0, " %02x", record->bytes[i]);
+    n += r > 0 ? r : 0;
+  }
+  if (record->count < record->length) {
+    r = snprintf(buf + ((size_t)n < size ? n : size), (size_t)n < size ? size - n : 0, " ..");
+    n += r > 0 ? r : 0;
+  }
+  return n;
+}
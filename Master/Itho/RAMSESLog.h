@@ -0,0 +1,153 @@
+/*
+ * Deferred, level-gated log for the radio and decode path.
+ *
+ * RAMSES_LOG() stores a small binary record (event, micros(), up to three
+ * integers and the first bytes of a frame) in a ring; nothing is formatted
+ * or printed where it happens. Whoever has time, a low priority task or the
+ * end of loop(), reads the records back and formats them with
+ * ramsesLogFormat(). Records above the runtime level are not made, records
+ * above RAMSES_LOG_LEVEL are not even compiled, and with RAMSES_LOG_LEVEL
+ * RAMSES_LOG_NONE the ring is gone as well.
+ *
+ * The ring takes records from any number of producers (the radio and the
+ * decoder side may run on different cores) without locking and is drained by
+ * one consumer. When it is full, new records are counted and dropped.
+ */
+
+#ifndef RAMSESLOG_H_
+#define RAMSESLOG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+
+#define RAMSES_LOG_NONE 0
+#define RAMSES_LOG_ERROR 1
+#define RAMSES_LOG_WARN 2
+#define RAMSES_LOG_INFO 3
+#define RAMSES_LOG_DEBUG 4
+
+//most verbose level compiled in
+#ifndef RAMSES_LOG_LEVEL
+#define RAMSES_LOG_LEVEL RAMSES_LOG_DEBUG
+#endif
+
+//records buffered until drained, must be a power of two
+#ifndef RAMSES_LOG_RING_SIZE
+#define RAMSES_LOG_RING_SIZE 16
+#endif
+
+//frame bytes copied into a record; the frame buffers are reused long before a drain
+#define RAMSES_LOG_BYTES 16
+
+enum RAMSESLogEvent {
+  RAMSES_LOG_PARSE_ERROR,       //decode_return_codes value
+  RAMSES_LOG_INTERPRET_ERROR,   //result, opcode, packed source ID
+  RAMSES_LOG_FIFO_OVERFLOW,     //bytes of the frame read so far
+  RAMSES_LOG_STREAM_REJECT,     //decode_return_codes value, bytes read, RAMSES_STAT_* reason; the bytes
+  RAMSES_LOG_RING_FULL,         //frames dropped so far
+  RAMSES_LOG_RAW_PACKET,        //the bytes
+  RAMSES_LOG_RAW_MESSAGE,       //the bytes
+};
+
+struct RAMSESLogRecord {
+  uint32_t timestamp;           //micros()
+  uint8_t event;                //RAMSESLogEvent
+  uint8_t level;
+  uint8_t count;                //bytes copied
+  uint8_t length;               //bytes the frame had
+  int32_t args[3];
+  uint8_t bytes[RAMSES_LOG_BYTES];
+};
+
+template <uint16_t N>
+class RAMSESLogRing
+{
+  static_assert(N > 0 && (N & (N - 1)) == 0, "RAMSESLogRing capacity must be a power of two");
+
+  public:
+    RAMSESLogRing() : head(0), tail(0), level(RAMSES_LOG_WARN), dropped(0) {
+      for (uint16_t i = 0; i < N; i++)
+        slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    bool enabled(uint8_t at) const { return at <= level.load(std::memory_order_relaxed); }
+    void setLevel(uint8_t at) { level.store(at, std::memory_order_relaxed); }
+    uint32_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+    //producer side, any context: claim a slot by moving head, fill it, then hand it over through its sequence
+    void record(uint8_t at, uint8_t event, uint32_t timestamp, int32_t a, int32_t b, int32_t c, const uint8_t *data, uint8_t length) {
+      uint32_t pos = head.load(std::memory_order_relaxed);
+      Slot *slot;
+      for (;;) {
+        slot = &slots[pos & (N - 1)];
+        int32_t diff = (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+        if (diff == 0 && head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+        if (diff < 0) {
+          dropped.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        if (diff > 0)
+          pos = head.load(std::memory_order_relaxed);
+      }
+
+      RAMSESLogRecord *r = &slot->record;
+      r->timestamp = timestamp;
+      r->event = event;
+      r->level = at;
+      r->args[0] = a;
+      r->args[1] = b;
+      r->args[2] = c;
+      r->length = length;
+      r->count = length < RAMSES_LOG_BYTES ? length : RAMSES_LOG_BYTES;
+      if (r->count)
+        memcpy(r->bytes, data, r->count);
+      slot->seq.store(pos + 1, std::memory_order_release);
+    }
+
+    //consumer side: oldest record, false when there is none
+    bool read(RAMSESLogRecord *out) {
+      Slot *slot = &slots[tail & (N - 1)];
+      if (slot->seq.load(std::memory_order_acquire) != tail + 1)
+        return false;
+      *out = slot->record;
+      slot->seq.store(tail + N, std::memory_order_release);
+      tail++;
+      return true;
+    }
+
+  private:
+    struct Slot {
+      std::atomic<uint32_t> seq;    //pos: free for the producer at pos, pos + 1: filled
+      RAMSESLogRecord record;
+    };
+
+    Slot slots[N];
+    std::atomic<uint32_t> head;     //next position to claim, shared by the producers
+    uint32_t tail;                  //consumer only
+    std::atomic<uint8_t> level;
+    std::atomic<uint32_t> dropped;
+};
+
+//one line for a record, snprintf() style, no newline
+int ramsesLogFormat(const RAMSESLogRecord *record, char *buf, size_t size);
+
+//RAMSES_LOG(ring, level, event, a, b, c) and RAMSES_LOG_DATA(.., data, length):
+//nothing at all above RAMSES_LOG_LEVEL, one compare above the runtime level
+#define RAMSES_LOG_AT(ring, at, event, a, b, c, data, length) \
+  do { \
+    if ((at) <= RAMSES_LOG_LEVEL && (ring).enabled(at)) \
+      (ring).record((at), (event), micros(), (a), (b), (c), (data), (length)); \
+  } while (0)
+
+#if RAMSES_LOG_LEVEL > RAMSES_LOG_NONE
+#define RAMSES_LOG(ring, at, event, a, b, c) RAMSES_LOG_AT(ring, at, event, a, b, c, NULL, 0)
+#define RAMSES_LOG_DATA(ring, at, event, a, b, c, data, length) RAMSES_LOG_AT(ring, at, event, a, b, c, data, length)
+#else
+#define RAMSES_LOG(ring, at, event, a, b, c) do {} while (0)
+#define RAMSES_LOG_DATA(ring, at, event, a, b, c, data, length) do {} while (0)
+#endif
+
+#endif /* RAMSESLOG_H_ */
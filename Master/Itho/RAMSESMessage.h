@@ -5,23 +5,42 @@
 #ifndef ITHOPACKET_H_
 #define ITHOPACKET_H_
 
-#include "bitbuffer.h"
+#include <stdint.h>
 
+//message bytes (checksum included) of a frame that fits in a CC1101Packet:
+//17 preamble bits, 3 header symbols, 2 symbols per byte and the trailer in 128 bytes
+#define RAMSES_MESSAGE_MAX 48
+
+//header_num_device_ids() never gives more
+#define RAMSES_MAX_DEVICE_IDS 3
+
+//fields of a message; payload and unparsed bytes are views into frame, so
+//the whole thing is about 70 bytes and can live on a small stack
 class RAMSESMessage
 {
   public:
-    bitbuffer_t bits;
+    //message bytes as received, checksum included; a message that is built
+    //for sending only fills the payload part, the encoder adds the rest
+    uint8_t frame[RAMSES_MESSAGE_MAX];
+    uint8_t frame_length;
 
     // from message_t
     uint8_t header;
     uint8_t num_device_ids;
-    uint8_t device_id[4][3];
+    uint8_t device_id[RAMSES_MAX_DEVICE_IDS][3];
     uint16_t command;
+    uint8_t payload_offset;
     uint8_t payload_length;
-    uint8_t payload[256];
+    uint8_t unparsed_offset;        //bytes after the payload, before the checksum
     uint8_t unparsed_length;
-    uint8_t unparsed[256];
     uint8_t crc;
+
+    uint8_t *payload() { return &frame[payload_offset]; }
+    const uint8_t *payload() const { return &frame[payload_offset]; }
+    const uint8_t *unparsed() const { return &frame[unparsed_offset]; }
+
+    //where the payload goes for num_device_ids, before building a message to send
+    void layoutPayload() { payload_offset = 1 + 3 * num_device_ids + 3; unparsed_offset = payload_offset; unparsed_length = 0; }
 };
 
 
@@ -0,0 +1,116 @@
+/*
+ * Receive quality counters: frames parsed, bytes read from the RX FIFO, FIFO
+ * overflows, frames lost to a full ring and every reason a frame is rejected
+ * for (disjoint, so they add up to the frames rejected).
+ *
+ * Counters are relaxed atomics, bumped from either side of RAMSES. tick()
+ * snapshots them once a minute; a rate compares a counter with the snapshot
+ * 1 (or 15) slots behind the latest, so the "1 minute" window spans 60 to
+ * 120 s, and never divides by less than the window.
+ */
+
+#ifndef RAMSESSTATS_H_
+#define RAMSESSTATS_H_
+
+#include <stdint.h>
+#include <atomic>
+
+enum RAMSESStat {
+  RAMSES_STAT_PARSED,           //frames processPacket() parsed, retransmissions included
+  RAMSES_STAT_BYTES,            //bytes read from the RX FIFO, rejected frames included
+  RAMSES_STAT_FIFO_OVERFLOW,    //RX FIFO overflows, the frame being read is lost
+  RAMSES_STAT_RING_FULL,        //good frames dropped because processPacket() fell behind, see RAMSES_RX_RING_SIZE
+  RAMSES_STAT_LENGTH,           //DECODE_ABORT_LENGTH: empty, or too long for the buffers
+  RAMSES_STAT_MIC,              //DECODE_FAIL_MIC: checksum
+  RAMSES_STAT_SANITY,           //DECODE_FAIL_SANITY: fields that do not fit the message
+  RAMSES_STAT_PREAMBLE,         //no FE 00 80 pattern after the sync word, mostly noise
+  RAMSES_STAT_HEADER,           //not the 33 55 53 Manchester breaking header
+  RAMSES_STAT_MANCHESTER,       //bad start/stop bit, or a symbol that is neither Manchester nor the trailer
+  RAMSES_STAT_TRAILER,          //0x35 trailer not where the payload length puts it
+  RAMSES_STATS
+};
+
+//rejection reasons, RAMSES_STAT_LENGTH through RAMSES_STAT_TRAILER
+#define RAMSES_STAT_FIRST_REJECT RAMSES_STAT_LENGTH
+
+//snapshots kept; readers go back at most RAMSES_STATS_MINUTES - 2, so one is always free for tick()
+#define RAMSES_STATS_MINUTES 17
+#define RAMSES_STATS_SLOT_MS 60000UL
+
+class RAMSESStats
+{
+  public:
+    RAMSESStats() : taken(0) {
+      for (uint8_t i = 0; i < RAMSES_STATS; i++)
+        counters[i].store(0, std::memory_order_relaxed);
+    }
+
+    void add(uint8_t stat, uint32_t n = 1) { counters[stat].fetch_add(n, std::memory_order_relaxed); }
+    uint32_t get(uint8_t stat) const { return counters[stat].load(std::memory_order_relaxed); }
+
+    static const char *name(uint8_t stat) {
+      static const char *const names[RAMSES_STATS] = {
+        "parsed", "bytes", "fifo overflow", "ring full", "length", "checksum", "sanity", "preamble", "header", "manchester", "trailer"
+      };
+      return stat < RAMSES_STATS ? names[stat] : "?";
+    }
+
+    uint32_t getRejected() const {
+      uint32_t sum = 0;
+      for (uint8_t i = RAMSES_STAT_FIRST_REJECT; i < RAMSES_STATS; i++)
+        sum += get(i);
+      return sum;
+    }
+
+    //now in ms (millis()); takes a snapshot on the first call and every RAMSES_STATS_SLOT_MS after
+    void tick(uint32_t now) {
+      uint32_t k = taken.load(std::memory_order_relaxed);
+      if (k && now - last(k)->ms.load(std::memory_order_relaxed) < RAMSES_STATS_SLOT_MS)
+        return;
+
+      //the slot held snapshot k - RAMSES_STATS_MINUTES: readers that see it overwritten also see taken moved on
+      Snapshot *s = &snapshots[k % RAMSES_STATS_MINUTES];
+      std::atomic_thread_fence(std::memory_order_release);
+      for (uint8_t i = 0; i < RAMSES_STATS; i++)
+        s->counts[i].store(get(i), std::memory_order_relaxed);
+      s->ms.store(now, std::memory_order_relaxed);
+      taken.store(k + 1, std::memory_order_release);
+    }
+
+    //per minute over the last minutes (1 to RAMSES_STATS_MINUTES - 2) plus the age of the latest snapshot,
+    //over at least the whole window when tick() does not go back that far yet; 0 before it ran
+    float rate(uint8_t stat, uint8_t minutes, uint32_t now) const {
+      if (minutes > RAMSES_STATS_MINUTES - 2)
+        minutes = RAMSES_STATS_MINUTES - 2;
+      for (;;) {
+        uint32_t k = taken.load(std::memory_order_acquire);
+        if (!k)
+          return 0;
+        uint32_t back = minutes < k ? minutes : k - 1;
+        const Snapshot *s = &snapshots[(k - 1 - back) % RAMSES_STATS_MINUTES];
+        uint32_t base = s->counts[stat].load(std::memory_order_relaxed);
+        uint32_t since = s->ms.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (taken.load(std::memory_order_relaxed) != k)
+          continue;
+        uint32_t ms = now - since;
+        if (ms < minutes * RAMSES_STATS_SLOT_MS)
+          ms = minutes * RAMSES_STATS_SLOT_MS;
+        return ms ? (get(stat) - base) * (float)RAMSES_STATS_SLOT_MS / ms : 0;
+      }
+    }
+
+  private:
+    struct Snapshot {
+      std::atomic<uint32_t> counts[RAMSES_STATS];
+      std::atomic<uint32_t> ms;
+    };
+
+    const Snapshot *last(uint32_t k) const { return &snapshots[(k - 1) % RAMSES_STATS_MINUTES]; }
+
+    std::atomic<uint32_t> counters[RAMSES_STATS];
+    Snapshot snapshots[RAMSES_STATS_MINUTES];
+    std::atomic<uint32_t> taken;    //snapshots taken, the latest is taken - 1
+};
+
+#endif /* RAMSESSTATS_H_ */
@@ -0,0 +1,87 @@
+/*
+ * Double-buffered, seqlock-published value with one writer and any number of
+ * readers.
+ *
+ * The writer fills the inactive slot in place (write()) and flips it active
+ * (publish()); it never waits for readers. A reader gets a const view of the
+ * active slot with read(), uses it in place and then asks valid() whether the
+ * writer started overwriting that slot meanwhile, which takes two publishes
+ * while it looked, and retries if so. No lock, so a slow reader on another
+ * task or core cannot hold up reception.
+ *
+ * The sequence counts half-steps: even when idle, odd while the writer is
+ * filling the inactive slot. Slot (seq / 2) & 1 is the active one either way.
+ */
+
+#ifndef SEQLOCKSNAPSHOT_H_
+#define SEQLOCKSNAPSHOT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+
+template <typename T>
+class SeqlockSnapshot
+{
+	public:
+		SeqlockSnapshot() : seq(0) {}
+
+		// writer side: the inactive slot, to fill in place; may be called
+		// again without publish() to start over
+		T *write()
+		{
+			uint32_t s = seq.load(std::memory_order_relaxed);
+			if (!(s & 1)) {
+				seq.store(s + 1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_release);
+			}
+			return &slots[(s / 2 + 1) & 1];
+		}
+
+		// writer side: make the slot returned by write() the active one
+		void publish()
+		{
+			uint32_t s = seq.load(std::memory_order_relaxed);
+			if (s & 1)
+				seq.store(s + 1, std::memory_order_release);
+		}
+
+		// reader side: the active slot, NULL before the first publish();
+		// only trust what was read from it if valid(*token) afterwards
+		const T *read(uint32_t *token) const
+		{
+			uint32_t s = seq.load(std::memory_order_acquire);
+			*token = s & ~1u;
+			return s < 2 ? NULL : &slots[(s / 2) & 1];
+		}
+
+		// reader side: false if the slot read() returned may have changed since
+		bool valid(uint32_t token) const
+		{
+			std::atomic_thread_fence(std::memory_order_acquire);
+			return seq.load(std::memory_order_relaxed) - token < 3;
+		}
+
+		// reader side: consistent copy of the active slot, false before the first publish()
+		bool copy(T *out) const
+		{
+			for (;;) {
+				uint32_t token;
+				const T *view = read(&token);
+				if (!view)
+					return false;
+				memcpy(out, view, sizeof(T));
+				if (valid(token))
+					return true;
+			}
+		}
+
+		uint32_t published() const { return seq.load(std::memory_order_acquire) / 2; }
+
+	private:
+		T slots[2];
+		std::atomic<uint32_t> seq;
+};
+
+#endif /* SEQLOCKSNAPSHOT_H_ */
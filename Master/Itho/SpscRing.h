@@ -0,0 +1,69 @@
+/*
+ * Fixed-capacity, lock-free single-producer/single-consumer ring.
+ *
+ * The producer claim()s the next free slot, fills it in place and
+ * publish()es it; the consumer peek()s the oldest slot, uses it in place and
+ * release()s it. Each index is written by one side only, so the two sides may
+ * run in an ISR and a task, on different cores or in different threads
+ * without further locking.
+ */
+
+#ifndef SPSCRING_H_
+#define SPSCRING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+template <typename T, uint16_t N>
+class SpscRing
+{
+	static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+	public:
+		SpscRing() : head(0), tail(0) {}
+
+		// producer side: next free slot, or NULL when the ring is full
+		T *claim()
+		{
+			uint16_t h = head.load(std::memory_order_relaxed);
+			if ((uint16_t)(h - tail.load(std::memory_order_acquire)) == N)
+				return NULL;
+			return &slots[h & (N - 1)];
+		}
+
+		// producer side: make the claimed slot visible to the consumer
+		void publish()
+		{
+			head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		// consumer side: oldest published slot, or NULL when the ring is empty
+		T *peek()
+		{
+			uint16_t t = tail.load(std::memory_order_relaxed);
+			if (t == head.load(std::memory_order_acquire))
+				return NULL;
+			return &slots[t & (N - 1)];
+		}
+
+		// consumer side: hand the slot returned by peek() back to the producer
+		void release()
+		{
+			tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		uint16_t size() const
+		{
+			return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+		}
+
+		static uint16_t capacity() { return N; }
+
+	private:
+		T slots[N];
+		std::atomic<uint16_t> head;     // written by the producer only
+		std::atomic<uint16_t> tail;     // written by the consumer only
+};
+
+#endif /* SPSCRING_H_ */
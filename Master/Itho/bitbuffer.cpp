@@ -211,8 +211,13 @@ static inline uint8_t bit_at(const uint8_t *bytes, unsigned bit)
 unsigned bitbuffer_search(bitbuffer_t *bitbuffer, unsigned row, unsigned start,
         const uint8_t *pattern, unsigned pattern_bits_len)
 {
-    uint8_t *bits = bitbuffer->bb[row];
-    unsigned len  = bitbuffer->bits_per_row[row];
+    return bitrow_search(bitbuffer->bb[row], bitbuffer->bits_per_row[row], start,
+            pattern, pattern_bits_len);
+}
+
+static unsigned bitrow_search_bitwise(uint8_t const *bits, unsigned len, unsigned start,
+        const uint8_t *pattern, unsigned pattern_bits_len)
+{
     unsigned ipos = start;
     unsigned ppos = 0; // cursor on init pattern
 
@@ -234,6 +239,75 @@ unsigned bitbuffer_search(bitbuffer_t *bitbuffer, unsigned row, unsigned start,
     return len;
 }
 
+/// Read 8 bytes starting at column col as a big-endian word, zero past num_cols.
+static inline uint64_t bitrow_get_word64(uint8_t const *bitrow, unsigned col, unsigned num_cols)
+{
+    uint64_t word = 0;
+    for (unsigned i = 0; i < 8; ++i)
+        word = word << 8 | (col + i < num_cols ? bitrow[col + i] : 0);
+    return word;
+}
+
+unsigned bitrow_search(uint8_t const *bits, unsigned len, unsigned start,
+        const uint8_t *pattern, unsigned pattern_bits_len)
+{
+    if (pattern_bits_len == 0 || pattern_bits_len > 64)
+        return bitrow_search_bitwise(bits, len, start, pattern, pattern_bits_len);
+    if (start >= len || len - start < pattern_bits_len)
+        return len;
+
+    // Pattern left aligned in a 64-bit word; the row is viewed through a
+    // 64-bit window that slides one byte at a time, and each of the eight
+    // bit offsets within that byte is a single masked compare.
+    uint64_t mask = ~(uint64_t)0 << (64 - pattern_bits_len);
+    uint64_t pat  = 0;
+    for (unsigned i = 0; i < (pattern_bits_len + 7) / 8; ++i)
+        pat |= (uint64_t)pattern[i] << (56 - 8 * i);
+    pat &= mask;
+
+    unsigned num_cols = (len + 7) / 8;
+    unsigned last     = len - pattern_bits_len; // last possible match position
+    unsigned col      = start / 8;
+    unsigned shift    = start % 8;
+    uint64_t word     = bitrow_get_word64(bits, col, num_cols);
+
+    for (;;) {
+        uint8_t next = col + 8 < num_cols ? bits[col + 8] : 0;
+
+        for (; shift < 8; ++shift) {
+            unsigned pos = col * 8 + shift;
+            if (pos > last)
+                return len;
+            uint64_t window = shift ? word << shift | next >> (8 - shift) : word;
+            if ((window & mask) == pat)
+                return pos;
+        }
+
+        word  = word << 8 | next;
+        shift = 0;
+        col++;
+    }
+}
+
+uint8_t const manchester_lut[256] = {
+    0xf0, 0xe1, 0xe0, 0xf1, 0xd2, 0xc3, 0xc2, 0xd3, 0xd0, 0xc1, 0xc0, 0xd1, 0xf2, 0xe3, 0xe2, 0xf3,
+    0xb4, 0xa5, 0xa4, 0xb5, 0x96, 0x87, 0x86, 0x97, 0x94, 0x85, 0x84, 0x95, 0xb6, 0xa7, 0xa6, 0xb7,
+    0xb0, 0xa1, 0xa0, 0xb1, 0x92, 0x83, 0x82, 0x93, 0x90, 0x81, 0x80, 0x91, 0xb2, 0xa3, 0xa2, 0xb3,
+    0xf4, 0xe5, 0xe4, 0xf5, 0xd6, 0xc7, 0xc6, 0xd7, 0xd4, 0xc5, 0xc4, 0xd5, 0xf6, 0xe7, 0xe6, 0xf7,
+    0x78, 0x69, 0x68, 0x79, 0x5a, 0x4b, 0x4a, 0x5b, 0x58, 0x49, 0x48, 0x59, 0x7a, 0x6b, 0x6a, 0x7b,
+    0x3c, 0x2d, 0x2c, 0x3d, 0x1e, 0x0f, 0x0e, 0x1f, 0x1c, 0x0d, 0x0c, 0x1d, 0x3e, 0x2f, 0x2e, 0x3f,
+    0x38, 0x29, 0x28, 0x39, 0x1a, 0x0b, 0x0a, 0x1b, 0x18, 0x09, 0x08, 0x19, 0x3a, 0x2b, 0x2a, 0x3b,
+    0x7c, 0x6d, 0x6c, 0x7d, 0x5e, 0x4f, 0x4e, 0x5f, 0x5c, 0x4d, 0x4c, 0x5d, 0x7e, 0x6f, 0x6e, 0x7f,
+    0x70, 0x61, 0x60, 0x71, 0x52, 0x43, 0x42, 0x53, 0x50, 0x41, 0x40, 0x51, 0x72, 0x63, 0x62, 0x73,
+    0x34, 0x25, 0x24, 0x35, 0x16, 0x07, 0x06, 0x17, 0x14, 0x05, 0x04, 0x15, 0x36, 0x27, 0x26, 0x37,
+    0x30, 0x21, 0x20, 0x31, 0x12, 0x03, 0x02, 0x13, 0x10, 0x01, 0x00, 0x11, 0x32, 0x23, 0x22, 0x33,
+    0x74, 0x65, 0x64, 0x75, 0x56, 0x47, 0x46, 0x57, 0x54, 0x45, 0x44, 0x55, 0x76, 0x67, 0x66, 0x77,
+    0xf8, 0xe9, 0xe8, 0xf9, 0xda, 0xcb, 0xca, 0xdb, 0xd8, 0xc9, 0xc8, 0xd9, 0xfa, 0xeb, 0xea, 0xfb,
+    0xbc, 0xad, 0xac, 0xbd, 0x9e, 0x8f, 0x8e, 0x9f, 0x9c, 0x8d, 0x8c, 0x9d, 0xbe, 0xaf, 0xae, 0xbf,
+    0xb8, 0xa9, 0xa8, 0xb9, 0x9a, 0x8b, 0x8a, 0x9b, 0x98, 0x89, 0x88, 0x99, 0xba, 0xab, 0xaa, 0xbb,
+    0xfc, 0xed, 0xec, 0xfd, 0xde, 0xcf, 0xce, 0xdf, 0xdc, 0xcd, 0xcc, 0xdd, 0xfe, 0xef, 0xee, 0xff,
+};
+
 unsigned bitbuffer_manchester_decode(bitbuffer_t *inbuf, unsigned row, unsigned start,
         bitbuffer_t *outbuf, unsigned max)
 {
@@ -244,6 +318,29 @@ unsigned bitbuffer_manchester_decode(bitbuffer_t *inbuf, unsigned row, unsigned
     if (max && len > start + (max * 2))
         len = start + (max * 2);
 
+    // Byte at a time while the output is byte aligned and no invalid pair
+    // is seen; the bit loop below takes over at the first error so the
+    // returned position is the same.
+    unsigned orow = outbuf->num_rows ? outbuf->num_rows - 1 : 0;
+    unsigned obits = outbuf->bits_per_row[orow];
+    if ((obits & 7) == 0) {
+        uint8_t *out = outbuf->bb[orow];
+        while (ipos + 16 <= len && obits + 8 <= BITBUF_COLS * 8) {
+            uint8_t hi = manchester_lut[bitrow_get_byte(bits, ipos)];
+            uint8_t lo = manchester_lut[bitrow_get_byte(bits, ipos + 8)];
+            if ((hi | lo) & 0xF0)
+                break;
+            out[obits >> 3] = (uint8_t)(hi << 4 | (lo & 0x0F));
+            obits += 8;
+            ipos += 16;
+        }
+        if (obits != outbuf->bits_per_row[orow]) {
+            if (outbuf->num_rows == 0)
+                outbuf->free_row = outbuf->num_rows = 1;
+            outbuf->bits_per_row[orow] = obits;
+        }
+    }
+
     while (ipos < len) {
         uint8_t bit1, bit2;
 
@@ -100,6 +100,18 @@ void bitbuffer_parse(bitbuffer_t *bits, const char *code);
 unsigned bitbuffer_search(bitbuffer_t *bitbuffer, unsigned row, unsigned start,
         const uint8_t *pattern, unsigned pattern_bits_len);
 
+/// Search a bit row (byte buffer) of bit_len bits, starting from bit 'start',
+/// for the pattern provided. Return the location of the first match, or
+/// bit_len if no match is found.
+/// Patterns of up to 64 bits are matched with one masked word compare per
+/// bit position; longer patterns fall back to a bit by bit search.
+unsigned bitrow_search(uint8_t const *bitrow, unsigned bit_len, unsigned start,
+        const uint8_t *pattern, unsigned pattern_bits_len);
+
+/// Manchester decoding of one byte (four bit pairs, high-low is 0, low-high is 1).
+/// The low nibble holds the decoded bits, the high nibble flags invalid pairs.
+extern uint8_t const manchester_lut[256];
+
 /// Manchester decoding from one bitbuffer into another, starting at the
 /// specified row and start bit. Decode at most 'max' data bits (i.e. 2*max)
 /// bits from the input buffer). Return the bit position in the input row
@@ -1,8 +1,9 @@
 /*
    Original Author: Klusjesman & supersjimmie
 
-   Tested with STK500 + ATMega328P
-   GCC-AVR compiler
+   Originally tested with STK500 + ATMega328P, GCC-AVR compiler. No longer
+   builds there: the RAMSES class needs <atomic> and ~6 KB of static RAM
+   (see RAMSES.h), the ATMega328P has 2 KB. ESP8266/ESP32 only.
 
    Modified by arjenhiemstra:
    Complete rework of the itho packet section, cleanup and easier to understand
@@ -37,39 +38,77 @@
 
 #define ITHO_IRQ_PIN 22 // pin 17 / D22
 
+// stream a binary capture of every frame read (see RAMSESCapture.h) on Serial instead of text;
+// give the recorder a flash File instead to keep it on the device
+//#define CAPTURE_TO_SERIAL
+
 RAMSES rf;
+RAMSESEventPrinter printer;
+#if defined(CAPTURE_TO_SERIAL)
+RAMSESRecorder recorder(Serial);
+#endif
 
-ICACHE_RAM_ATTR void ITHOcheck();
 void showPacket(const RAMSES &rf);
 
+#if defined(ESP32)
+// decode on the other core, so loop() only has to move frames off the radio
+void decodeTask(void *) {
+  for (;;) {
+    if (!rf.processPacket())
+      vTaskDelay(1);
+  }
+}
+
+// the deferred log (or the capture) is written out at the lowest priority, never in the receive path
+void logTask(void *) {
+  for (;;) {
+#if defined(CAPTURE_TO_SERIAL)
+    if (!recorder.drain())
+#else
+    if (!rf.printLog(4))
+#endif
+      vTaskDelay(10);
+  }
+}
+#endif
+
 void setup(void) {
   Serial.begin(115200);
   delay(500);
 
+#if defined(CAPTURE_TO_SERIAL)
+  rf.init();
+  rf.setRecorder(&recorder);  // nothing else goes out on Serial
+#else
   Serial.println("Initialization");
   // rf.setDeviceID(130, 11, 156);
   rf.init();
+  rf.subscribe(&printer);  // what the fan and its remotes say, on Serial
 
   //Serial.println("Registering");
   //sendRegister();
 
   Serial.println("Listening for messages");
-  pinMode(ITHO_IRQ_PIN, INPUT);
-  attachInterrupt(ITHO_IRQ_PIN, ITHOcheck, FALLING);
+#endif
+  rf.enableInterrupt(ITHO_IRQ_PIN);  // GDO2, end of packet
+#if defined(ESP32)
+  xTaskCreatePinnedToCore(decodeTask, "decode", 4096, NULL, 1, NULL, 0);
+  xTaskCreatePinnedToCore(logTask, "log", 4096, NULL, 0, NULL, 0);
+#endif
 }
 
-bool has_packet = false;
-
 void loop(void) {
-  // if (has_packet) {
-    if (rf.checkForNewPacket()) {
-      has_packet = false;
-    }
-  // }
-}
-
-ICACHE_RAM_ATTR void ITHOcheck() {
-  has_packet = true;
+  // no SPI traffic until GDO2 signals the end of a packet
+#if defined(ESP32)
+  rf.receivePacket();
+#else
+  rf.checkForNewPacket();
+#if defined(CAPTURE_TO_SERIAL)
+  recorder.drain(64);
+#else
+  rf.printLog(1);
+#endif
+#endif
 }
 
 const char *int_to_binary_str(int x, int N_bits){